@@ -26,6 +26,41 @@ using input_vector = Array<uint8_t, 142, 1>;
         // +--------+--------+--------+--------+--------+--------+--------+--------+
 
 
+/**
+ * Random keys used for Zobrist hashing of board positions.
+ * Generated by splitmix64 from a fixed seed, so hashes are the same in every run.
+ */
+struct ZobristKeys {
+    uint64_t whitePawn[256];    ///<keys for white pawn positions
+    uint64_t blackPawn[256];    ///<keys for black pawn positions
+    uint64_t walls[128];        ///<keys for wall placements
+    uint64_t whiteWalls[11];    ///<keys for white's remaining wall count
+    uint64_t blackWalls[11];    ///<keys for black's remaining wall count
+    uint64_t whiteTurn;         ///<key xored in when it's white's turn
+    uint64_t ply[256];          ///<keys for the ply of a position (used by the transposition table)
+
+    ZobristKeys(){
+        uint64_t state = 0x5eed5eed5eed5eedULL;
+        auto next = [&state](){
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        };
+
+        for (int i = 0; i < 256; i++) whitePawn[i] = next();
+        for (int i = 0; i < 256; i++) blackPawn[i] = next();
+        for (int i = 0; i < 128; i++) walls[i] = next();
+        for (int i = 0; i < 11; i++) whiteWalls[i] = next();
+        for (int i = 0; i < 11; i++) blackWalls[i] = next();
+        whiteTurn = next();
+        for (int i = 0; i < 256; i++) ply[i] = next();
+    }
+};
+
+const ZobristKeys ZOBRIST;
+
+
 /**
  * Represents the game board for Quoridor.
  * Handles pawn movements, wall placements, game state, and pathfinding logic.
@@ -253,20 +288,54 @@ class Board
 
 
     /**
-     * Updates in undo.
+     * Checks if a wall place is blocked by a wall on the board.
      *
      * @param wallPlacement wallPlacement (no leading 1 -> between 0-127)
+     * @return true if a placed wall overlaps or crosses @param wallPlacement
+     */
+    inline bool isWallPlaceTaken(uint8_t wallPlacement){
+        bool isHorizontal = wallPlacement & 0x40;
+
+        if (isHorizontal){
+            return wallsOnBoard[wallPlacement] || wallsOnBoard[wallPlacement - 0x40]
+                || ((wallPlacement & 7) < 7 && wallsOnBoard[wallPlacement + 1])
+                || ((wallPlacement & 7) > 0 && wallsOnBoard[wallPlacement - 1]);
+        }
+
+        return wallsOnBoard[wallPlacement] || wallsOnBoard[wallPlacement + 0x40]
+            || ((wallPlacement & 56) >> 3 < 7 && wallsOnBoard[wallPlacement + 8])
+            || ((wallPlacement & 56) >> 3 > 0 && wallsOnBoard[wallPlacement - 8]);
+    }
+
+
+    /**
+     * Updates takenWallPlaces in undo.
+     * Only the places the wall took are recalculated, other walls may still block them.
+     *
+     * @param wallPlacement wallPlacement (no leading 1 -> between 0-127)    ASSUMPTION: already removed from wallsOnBoard
      * @return void
      */
     inline void updateTakenWallPlacesUndo(uint8_t wallPlacement){
-        // This function recalculates taken wall places => slower than updateTakenWallPlaces
-        for (int i = 0; i < 128; i++){
-            takenWallPlaces[i] = false;
+        takenWallPlaces[wallPlacement] = isWallPlaceTaken(wallPlacement);
+        bool isHorizontal = wallPlacement & 0x40;
+
+        if (isHorizontal){
+            takenWallPlaces[wallPlacement - 0x40] = isWallPlaceTaken(wallPlacement - 0x40);
+            if((wallPlacement & 7) < 7){
+                takenWallPlaces[wallPlacement + 1] = isWallPlaceTaken(wallPlacement + 1);
+            }
+            if((wallPlacement & 7) > 0){
+                takenWallPlaces[wallPlacement - 1] = isWallPlaceTaken(wallPlacement - 1);
+            }
         }
 
-        for (int wallPlacement = 0; wallPlacement < 128; wallPlacement++){
-            if (wallsOnBoard[wallPlacement]){
-                updateTakenWallPlaces(wallPlacement);
+        if (!isHorizontal){
+            takenWallPlaces[wallPlacement + 0x40] = isWallPlaceTaken(wallPlacement + 0x40);
+            if((wallPlacement & 56) >> 3 < 7){
+                takenWallPlaces[wallPlacement + 8] = isWallPlaceTaken(wallPlacement + 8);
+            }
+            if((wallPlacement & 56) >> 3 > 0){
+                takenWallPlaces[wallPlacement - 8] = isWallPlaceTaken(wallPlacement - 8);
             }
         }
     }
@@ -1099,7 +1168,7 @@ class Board
             (move & 8) ? nextCell += (move & 48) : nextCell -= (move & 48);
             (move & 4) ? nextCell += (move & 3) : nextCell -= (move & 3);
 
-            if(nextCell != opponentPawn && (nextCell == path[pathSize - 1] || nextCell == path[pathSize - 2])){
+            if(nextCell != opponentPawn && (nextCell == path[pathSize - 1] || (pathSize > 1 && nextCell == path[pathSize - 2]))){
                 return move;
             }
         }
@@ -1110,6 +1179,77 @@ class Board
     }
 
 
+    /**
+     * Finds a pawn move reaching the goal.
+     * Only a pawn at most two rows from its goal row (a step or a hop away) can have one.
+     *
+     * @param player true: white, false: black
+     * @return winning pawn move, 0 if there is none
+     */
+    uint8_t winningPawnMove(bool player){
+        uint8_t pawn = player ? whitePawn : blackPawn;
+        int goalDistance = player ? 8 - (pawn >> 4) : pawn >> 4;
+        if(goalDistance > 2){
+            return 0;
+        }
+
+        uint8_t possibleMoves[8];
+        size_t moveCount = 0;
+        generatePossiblePawnMoves(player, possibleMoves, moveCount);
+
+        for(size_t i = 0; i < moveCount; i++){
+            uint8_t move = possibleMoves[i];
+
+            uint8_t nextCell = pawn;
+            (move & 8) ? nextCell += (move & 48) : nextCell -= (move & 48);
+            (move & 4) ? nextCell += (move & 3) : nextCell -= (move & 3);
+
+            if((nextCell > 127 && player) || (nextCell < 9 && !player)){
+                return move;
+            }
+        }
+        return 0;
+    }
+
+
+    /**
+     * Generates the wall placements stopping the opponent from winning with their next move (see winningPawnMove).
+     * Only horizontal walls in front of the opponent's goal row, next to the opponent's pawn, are tried:
+     * every step or hop into the goal row crosses one of them.
+     *
+     * @param player player placing the wall, true: white, false: black
+     * @param possibleMoves array of wall placement moves (with leading 1)
+     * @param moveCount number of elements in array
+     * @return void -> updates @param possibleMoves and @param moveCount
+     */
+    void generateBlockingWalls(bool player, uint8_t* possibleMoves, size_t& moveCount){
+        if ((player && !whiteWalls) || (!player && !blackWalls)){
+            return;
+        }
+
+        uint8_t opponentPawn = player ? blackPawn : whitePawn;
+        int column = opponentPawn & 0x0f;
+        // The boundary before the goal row, and the one before it for hops
+        uint8_t rows[2] = {(uint8_t) (player ? 0 : 7), (uint8_t) (player ? 1 : 6)};
+
+        for(uint8_t i : rows){
+            for(int j = max(column - 2, 0); j <= min(column + 1, 7); j++){
+                uint8_t wallPlacement = 0x40 | i << 3 | j;
+                if(takenWallPlaces[wallPlacement]){
+                    continue;
+                }
+
+                executeWallPlacement(wallPlacement);
+                bool blocks = !winningPawnMove(!player);
+                undoWallPlacement(wallPlacement);
+                if(blocks){
+                    addWallIfPlacementValid(wallPlacement, possibleMoves, moveCount);
+                }
+            }
+        }
+    }
+
+
     /**
      * Evaluate move
      * 
@@ -1252,7 +1392,21 @@ class Board
      * @return input_vector Eigen array encoding board features
      */
     input_vector toInputVector(bool player) {
-        input_vector input = input_vector::Zero();
+        input_vector input;
+        toInputVector(player, input);
+        return input;
+    }
+
+
+    /**
+     * Encodes the current board into a 142-element vector for GP input, in place.
+     *
+     * @param player true: white, false: black
+     * @param input Output, Eigen array encoding board features
+     * @return void
+     */
+    void toInputVector(bool player, input_vector& input) {
+        input.setZero();
 
         // Encode 4 8-bit values
         input(0) = whitePawn;
@@ -1294,8 +1448,96 @@ class Board
         input(11) = playerPawnMoves[2];
         input(12) = playerPawnMoves[3];
         input(13) = playerPawnMoves[4];
+    }
 
-        return input;
+
+    /**
+     * Mirrors a cell onto the other side of the board (left <-> right).
+     *
+     * @param cell cell
+     * @return mirrored cell
+     */
+    static inline uint8_t mirrorCell(uint8_t cell){
+        return (cell & 0xf0) + 8 - (cell & 0x0f);
+    }
+
+
+    /**
+     * Mirrors a move onto the other side of the board (left <-> right).
+     *
+     * @param move move encoding
+     * @return mirrored move encoding
+     */
+    static inline uint8_t mirrorMove(uint8_t move){
+        if (move >> 7){
+            // Wall between columns j and j + 1 ends up between columns 7 - j and 8 - j
+            return (move & 0b11111000) + 7 - (move & 7);
+        }
+
+        // Flip the direction of the horizontal movement (if there is any)
+        return (move & 3) ? move ^ 4 : move;
+    }
+
+
+    /**
+     * Calculates the Zobrist hash of the position.
+     *
+     * @param player player to move, true: white, false: black
+     * @param mirrored whether to hash the mirrored position instead
+     * @return Zobrist hash
+     */
+    uint64_t zobristHash(bool player, bool mirrored = false){
+        uint64_t hash = player ? ZOBRIST.whiteTurn : 0;
+        hash ^= ZOBRIST.whitePawn[mirrored ? mirrorCell(whitePawn) : whitePawn];
+        hash ^= ZOBRIST.blackPawn[mirrored ? mirrorCell(blackPawn) : blackPawn];
+        hash ^= ZOBRIST.whiteWalls[whiteWalls];
+        hash ^= ZOBRIST.blackWalls[blackWalls];
+
+        for (int wallPlacement = 0; wallPlacement < 128; wallPlacement++){
+            if (wallsOnBoard[wallPlacement]){
+                hash ^= ZOBRIST.walls[mirrored ? mirrorMove(128 + wallPlacement) & 0x7f : wallPlacement];
+            }
+        }
+
+        return hash;
+    }
+
+
+    /**
+     * Incrementally calculates the Zobrist hash of the position after a move, without executing it.
+     *
+     * @param hash Zobrist hash of the current position (mirrored if @param mirrored)
+     * @param move move encoding   ASSUMPTION: move is valid
+     * @param player true: white, false: black
+     * @param mirrored whether @param hash is the hash of the mirrored position
+     * @return Zobrist hash after the move
+     */
+    uint64_t zobristHashAfterMove(uint64_t hash, uint8_t move, bool player, bool mirrored = false){
+        hash ^= ZOBRIST.whiteTurn;
+
+        if (move >> 7){
+            uint8_t wallPlacement = (mirrored ? mirrorMove(move) : move) & 0x7f;
+            hash ^= ZOBRIST.walls[wallPlacement];
+            if (player){
+                hash ^= ZOBRIST.whiteWalls[whiteWalls] ^ ZOBRIST.whiteWalls[whiteWalls - 1];
+            } else {
+                hash ^= ZOBRIST.blackWalls[blackWalls] ^ ZOBRIST.blackWalls[blackWalls - 1];
+            }
+            return hash;
+        }
+
+        uint8_t pawn = player ? whitePawn : blackPawn;
+        uint8_t newPawn = pawn;
+        (move & 8) ? newPawn += (move & 48) : newPawn -= (move & 48);
+        (move & 4) ? newPawn += (move & 3) : newPawn -= (move & 3);
+
+        if (mirrored){
+            pawn = mirrorCell(pawn);
+            newPawn = mirrorCell(newPawn);
+        }
+
+        const uint64_t* pawnKeys = player ? ZOBRIST.whitePawn : ZOBRIST.blackPawn;
+        return hash ^ pawnKeys[pawn] ^ pawnKeys[newPawn];
     }
 
 
@@ -1378,8 +1620,9 @@ class Board
 
     /**
      * Copy constructor.
+     * It cannot throw, so containers of structs holding a board move those structs when they grow, instead of copying them.
      */
-    Board(const Board& other){
+    Board(const Board& other) noexcept {
         this->whitePawn = other.whitePawn;
         this->blackPawn = other.blackPawn;
 
@@ -17,6 +17,8 @@ int ROLLOUTS = 10000;
 int SIMULATIONS_PER_ROLLOUT = 3;
 int ROLLOUT_PARAMETER = 4;
 float MCTS_PARAMETER = 0.5;
+string ANALYSIS_CACHE_FILE = "datasets/analysis.cache";    // searched positions reused by later runs (see MCTS::openAnalysisCache)
+int ROOT_WORKERS = 1;    // processes searching each position, their visits are merged (see MCTS::searchRootParallel)
 MCTS agent = MCTS(ROLLOUTS, SIMULATIONS_PER_ROLLOUT, MCTS_PARAMETER, ROLLOUT_PARAMETER, "", false, 0);
 
 
@@ -90,43 +92,46 @@ void generateData(Board* board, string saveFileNameWhite, string saveFileNameBla
 
 /**
  * Generates random board position 
+ * 
+ * @param whiteWalls number of walls white has left
+ * @param blackWalls number of walls black has left
+ * @param random random number generator
  */
-Board createRandomPosition(uint8_t whiteWalls, uint8_t blackWalls){
-    srand(time(NULL));
+Board createRandomPosition(uint8_t whiteWalls, uint8_t blackWalls, FastRandom& random){
     Board board = Board();
 
     // Need to pay attention that it is not a terminal position (no one is winning), this also was a fun debug...
-    uint8_t whiteRow = rand() % 8;
-    uint8_t whiteCol = rand() % 9;
-    uint8_t blackRow = rand() % 8 + 1;
-    uint8_t blackCol = rand() % 9;
+    uint8_t whiteRow = random.below(8);
+    uint8_t whiteCol = random.below(9);
+    uint8_t blackRow = random.below(8) + 1;
+    uint8_t blackCol = random.below(9);
     while(blackRow == whiteRow && whiteCol == blackCol){
-        blackRow = rand() % 9;
-        blackCol = rand() % 9;
+        blackRow = random.below(9);
+        blackCol = random.below(9);
     }
 
     board.whitePawn = whiteRow * 16 + whiteCol;
     board.blackPawn = blackRow * 16 + blackCol;
 
     for(int i = 0; i < 10 - whiteWalls; i++){
-        uint8_t iWall = rand() % 8;
-        uint8_t jWall = rand() % 8;
-        bool horizontal = rand() % 2;
+        uint8_t iWall = random.below(8);
+        uint8_t jWall = random.below(8);
+        bool horizontal = random.below(2);
         while(!board.placeWall(iWall, jWall, horizontal, true)){
-            iWall = rand() % 8;
-            jWall = rand() % 8;
-            horizontal = rand() % 2;
+            iWall = random.below(8);
+            jWall = random.below(8);
+            horizontal = random.below(2);
         }
     }
 
     for(int i = 0; i < 10 - blackWalls; i++){
-        uint8_t iWall = rand() % 8;
-        uint8_t jWall = rand() % 8;
-        bool horizontal = rand() % 2;
+        uint8_t iWall = random.below(8);
+        uint8_t jWall = random.below(8);
+        bool horizontal = random.below(2);
         while(!board.placeWall(iWall, jWall, horizontal, false)){
-            iWall = rand() % 8;
-            jWall = rand() % 8;
-            horizontal = rand() % 2;
+            iWall = random.below(8);
+            jWall = random.below(8);
+            horizontal = random.below(2);
         }
     }
 
@@ -144,6 +149,8 @@ void createDataSetNatural() {
     // Delete the save file if it exists
     remove(saveFileNameWhite.c_str());
     remove(saveFileNameBlack.c_str());
+    agent.openAnalysisCache(ANALYSIS_CACHE_FILE);
+    agent.rootWorkers = ROOT_WORKERS;
 
     int branchings[40] = {2, 2, 2, 2, 1, 1, 2, 1,
                           1, 2, 1, 1, 2, 1, 1, 2,
@@ -241,9 +248,14 @@ void createDataSetNatural() {
 
 /**
  * Pad the datasets, so each contains at least 1000 + 100 datapoints
+ * 
+ * @param seed seed of the random positions, 0: seed from the clock
  */
-void padDataSetArtificially(bool player, string saveFileName) {
+void padDataSetArtificially(bool player, string saveFileName, uint64_t seed = 0) {
     unordered_set<Board, BoardHasher> seenBoards;
+    FastRandom random(seed);
+    agent.openAnalysisCache(ANALYSIS_CACHE_FILE);
+    agent.rootWorkers = ROOT_WORKERS;
 
     const size_t maxBoards = 100000;
     Board* boards = new Board[maxBoards];
@@ -267,7 +279,7 @@ void padDataSetArtificially(bool player, string saveFileName) {
             int blackWalls = 0;
 
             for(int j = 0; j < 20 - i; j++){
-                if(rand() % 2){
+                if(random.below(2)){
                     whiteWalls++;
                 }
                 else{
@@ -285,9 +297,9 @@ void padDataSetArtificially(bool player, string saveFileName) {
                 blackWalls = 10;
             }
 
-            Board board = createRandomPosition(whiteWalls, blackWalls);
+            Board board = createRandomPosition(whiteWalls, blackWalls, random);
             while(seenBoards.find(board) != seenBoards.end()){
-                board = createRandomPosition(whiteWalls, blackWalls);
+                board = createRandomPosition(whiteWalls, blackWalls, random);
             }
             seenBoards.insert(board);
 
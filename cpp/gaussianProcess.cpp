@@ -1,3 +1,8 @@
+// Products of predict_batch take GP_PRODUCT_DEPTH training points at a time, so the blocks Eigen packs for them stay
+// under this limit and are kept on the stack instead of being allocated on every call (must precede the first Eigen include)
+#ifndef EIGEN_STACK_ALLOCATION_LIMIT
+#define EIGEN_STACK_ALLOCATION_LIMIT 524288
+#endif
 #include <Eigen/Dense>
 #include <vector>
 #include <cmath>
@@ -11,6 +16,10 @@
 #include <string>
 #include <iomanip>
 
+#define GP_PRODUCT_DEPTH 128    // training points per matrix product of a batch prediction
+
+static_assert(EIGEN_STACK_ALLOCATION_LIMIT >= GP_PRODUCT_DEPTH * 256 * sizeof(double), "Eigen was included before gaussianProcess.cpp raised its stack allocation limit");
+
 // This file uses snake case, maybe I will change the other code in the future, but this is so much easier to read...
  
 using namespace Eigen;
@@ -18,6 +27,32 @@ using namespace std;
 
 using input_vector = Array<uint8_t, 142, 1>;
 
+
+/**
+ * Preallocated buffers of predictions, the buffers only grow, so repeated predictions do not allocate
+ */
+struct gp_scratch {
+    MatrixXd k_stars;   // kernel vectors, one per column
+    VectorXd output;    // distribution of a single prediction
+    MatrixXd outputs;   // distributions of a batch, one per column
+
+
+    /**
+     * Grow the buffers to hold the kernel vectors and distributions of a batch
+     */
+    void reserve(int N, int B) {
+        if (k_stars.rows() < N || k_stars.cols() < B) {
+            k_stars.resize(max<Index>(k_stars.rows(), N), max<Index>(k_stars.cols(), B));
+        }
+        if (outputs.cols() < B) {
+            outputs.resize(256, B);
+        }
+        if (output.size() != 256) {
+            output.resize(256);
+        }
+    }
+};
+
 /**
  * Gaussian Process for Quoridor
  */
@@ -52,20 +87,73 @@ class Quoridor_GP {
      * Make prediction distribution 
      */
     VectorXd predict(const input_vector& x_star) const {
-        VectorXd k_star = compute_kernel_vector(x_star);
-        VectorXd output = k_star.transpose() * K_inv_;
+        gp_scratch scratch;
+        return predict(x_star, scratch);
+    }
 
-        // Eliminate illegal pawn moves
-        uint8_t possiblePawnMoves[12] = {1, 2, 5, 6, 16, 24, 32, 40, 17, 21, 25, 29};
-        for(int i = 0; i < 12; i++){
-            uint8_t m = possiblePawnMoves[i];
-            if (!((x_star(9) == m) || (x_star(10) == m) || (x_star(11) == m) || (x_star(12) == m) || (x_star(13) == m))) {
-                output(m) = 0;
+
+    /**
+     * Make prediction distribution in preallocated buffers
+     * The result lives in the buffers, so it is overwritten by the next prediction using them
+     */
+    const VectorXd& predict(const input_vector& x_star, gp_scratch& scratch) const {
+        int N = X_train_.size();
+        scratch.reserve(N, 1);
+        auto k_star = scratch.k_stars.col(0).head(N);
+        for (int i = 0; i < N; ++i) {
+            k_star(i) = custom_kernel(x_star, X_train_[i]);
+        }
+        scratch.output.noalias() = K_inv_.transpose() * k_star;
+
+        eliminate_illegal_pawn_moves(x_star, scratch.output);
+
+        // Normalised distribution, so can be interpreted as a probability distribution
+        normalise_in_place(scratch.output);
+        return scratch.output;
+    }
+
+
+    /**
+     * Make prediction distributions for several positions at once (one row per position)
+     */
+    MatrixXd predict_batch(const vector<input_vector>& x_stars) const {
+        gp_scratch scratch;
+        int B = x_stars.size();
+        predict_batch(x_stars.data(), B, scratch);
+        return scratch.outputs.leftCols(B).transpose();
+    }
+
+
+    /**
+     * Make prediction distributions for several positions at once in preallocated buffers
+     * The distributions are the first B columns of scratch.outputs, overwritten by the next prediction using them
+     * The kernel vectors are stacked into a matrix, so K_inv_ is read once for the whole batch
+     */
+    void predict_batch(const input_vector* x_stars, int B, gp_scratch& scratch) const {
+        int N = X_train_.size();
+        scratch.reserve(N, B);
+
+        // One kernel vector per column
+        for (int b = 0; b < B; ++b) {
+            for (int i = 0; i < N; ++i) {
+                scratch.k_stars(i, b) = custom_kernel(x_stars[b], X_train_[i]);
             }
         }
 
-        // Return normalised distribution, so can be interpreted as a probability distribution
-        return normalise_output(output);
+        // A single product over all training points would pack blocks too large for the stack
+        auto outputs = scratch.outputs.leftCols(B);
+        outputs.setZero();
+        for (int start = 0; start < N; start += GP_PRODUCT_DEPTH) {
+            int depth = min(GP_PRODUCT_DEPTH, N - start);
+            outputs.noalias() += K_inv_.middleRows(start, depth).transpose() * scratch.k_stars.block(start, 0, depth, B);
+        }
+
+        for (int b = 0; b < B; ++b) {
+            eliminate_illegal_pawn_moves(x_stars[b], outputs.col(b));
+
+            // Normalised distribution, so can be interpreted as a probability distribution
+            normalise_in_place(outputs.col(b));
+        }
     }
 
 
@@ -231,16 +319,31 @@ class Quoridor_GP {
 
 
     /**
-     * Normalise vector
+     * Zero the pawn moves not available in the position
+     */
+    void eliminate_illegal_pawn_moves(const input_vector& x_star, Ref<VectorXd> output) const {
+        uint8_t possiblePawnMoves[12] = {1, 2, 5, 6, 16, 24, 32, 40, 17, 21, 25, 29};
+        for(int i = 0; i < 12; i++){
+            uint8_t m = possiblePawnMoves[i];
+            if (!((x_star(9) == m) || (x_star(10) == m) || (x_star(11) == m) || (x_star(12) == m) || (x_star(13) == m))) {
+                output(m) = 0;
+            }
+        }
+    }
+
+
+    /**
+     * Normalise vector in place
      */
-    VectorXd normalise_output(const VectorXd& raw_output) const {
-        VectorXd result = raw_output.array().max(0.0);
-        double sum = result.sum();
+    void normalise_in_place(Ref<VectorXd> output) const {
+        output = output.array().max(0.0);
+        double sum = output.sum();
         if (sum > 0.0){
-            return result / sum;
+            output /= sum;
+            return;
         } 
 
-        return VectorXd::Constant(result.size(), 1.0 / result.size());
+        output.setConstant(1.0 / output.size());
     }
 };
 
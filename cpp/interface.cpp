@@ -10,6 +10,20 @@ using namespace std;
 // g++ -shared -Wl,-soname,interface -o cpp/interface.so -fPIC cpp/interface.cpp -Ilibs/eigen-3.4.0
 
 
+/**
+ * Enables pondering and asynchronous priors for an agent playing interactively.
+ * This is done once when the agent is built, its ponder thread reads these fields between calls.
+ * 
+ * @param agent Agent to configure
+ * @return bool Always true (initialises a static flag)
+ */
+static bool configureInteractiveAgent(MCTS& agent){
+    agent.ponder = true;
+    agent.asyncPriors = true;
+    return true;
+}
+
+
 extern "C" {
     struct Cell {
         int i;
@@ -32,7 +46,34 @@ extern "C" {
         }
 
         Board game = Board({whitePawn.i, whitePawn.j}, {blackPawn.i, blackPawn.j}, wallsVector, whiteWalls, blackWalls);
-        MCTS agent = MCTS(rollouts, 3, 0.25, 4, "cpp/GPmodels", true, 2);
+        // The agent is kept between calls, so the search tree of the previous decision can be reused,
+        // and it keeps pondering in the background while the user thinks
+        static MCTS agent = MCTS(rollouts, 3, 0.25, 4, "cpp/GPmodels", true, 2);
+        static bool configured = configureInteractiveAgent(agent);
+        (void) configured;
+
+        // The previous call's ponder thread reads the budget, it has to stop before the budget changes
+        agent.stopPondering();
+        agent.rollouts = rollouts;
+        agent.timeBudget = 0;
+        return agent.predictBestMove(game, player);
+    }
+
+
+    uint8_t calculateBestMoveInTime(Cell whitePawn, Cell blackPawn, Wall* walls, size_t length, int whiteWalls, int blackWalls, bool player, int milliseconds){
+        vector<pair<bool, pair<int, int>>> wallsVector = {};
+        for (size_t i = 0; i < length; i++){
+            Wall wall = walls[i];
+            wallsVector.push_back({wall.isHorizontal, {wall.i, wall.j}});
+        }
+
+        Board game = Board({whitePawn.i, whitePawn.j}, {blackPawn.i, blackPawn.j}, wallsVector, whiteWalls, blackWalls);
+        static MCTS agent = MCTS(10000, 3, 0.25, 4, "cpp/GPmodels", true, 2);
+        static bool configured = configureInteractiveAgent(agent);
+        (void) configured;
+
+        agent.stopPondering();
+        agent.timeBudget = milliseconds;
         return agent.predictBestMove(game, player);
     }
 
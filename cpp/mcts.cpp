@@ -5,8 +5,21 @@
 #include <thread>
 #include <atomic>
 #include <future>
-#include <Eigen/Dense>
 #include <filesystem>
+#include <memory>
+#include <climits>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cerrno>
 #include "gaussianProcess.cpp"
 
 
@@ -14,315 +27,3380 @@ using namespace Eigen;
 
 float MCTS_CONST = 0.25;
 
+#define UCT_TABLE_SIZE 16384
+#define ROLLOUT_LENGTH 40  // maximum plies of a rollout, the player closer to the goal wins after it
+#define CUTOFF_CHECK_INTERVAL 4  // plies between the lead checks of a truncated rollout
+#define SEARCH_PATH_CAPACITY 128  // selection depth the paths of a search are preallocated for (deeper selections grow them)
+#define ANALYSIS_CACHE_MAGIC 0x31454843414d5451ULL  // "QTMACHE1", identifies an AnalysisCache file
+#define ANALYSIS_CACHE_PROBES 8 // slots an AnalysisCache entry may be stored in
+#define SEARCH_VERSION 2    // part of the search fingerprint, raised when the search changes in ways its parameters do not show
+
+
+/**
+ * Precomputed terms of the UCT formula for small visit counts.
+ */
+struct UCTTables {
+    float sqrtLog[UCT_TABLE_SIZE];      ///<sqrt(log(n))
+    float inverseSqrt[UCT_TABLE_SIZE];  ///<1 / sqrt(n)
+
+    UCTTables(){
+        sqrtLog[0] = 0;
+        inverseSqrt[0] = 0;
+        for (int n = 1; n < UCT_TABLE_SIZE; n++){
+            sqrtLog[n] = sqrt(log((float) n));
+            inverseSqrt[n] = 1 / sqrt((float) n);
+        }
+    }
+
+
+    inline float sqrtLogOf(int n) const {
+        return n < UCT_TABLE_SIZE ? sqrtLog[n] : sqrt(log((float) n));
+    }
+
+
+    inline float inverseSqrtOf(int n) const {
+        return n < UCT_TABLE_SIZE ? inverseSqrt[n] : 1 / sqrt((float) n);
+    }
+};
+
+const UCTTables UCT_TABLES;
+
+
+// Search telemetry, compile with -DMCTS_TELEMETRY=1 to collect SearchStats (costs nothing when disabled)
+#ifndef MCTS_TELEMETRY
+#define MCTS_TELEMETRY 0
+#endif
+
+#if MCTS_TELEMETRY
+#define TELEMETRY(...) __VA_ARGS__
+#else
+#define TELEMETRY(...)
+#endif
+
+
+/**
+ * Counters of a search, collected when MCTS_TELEMETRY is enabled (all zero otherwise).
+ */
+struct SearchStats {
+    int rollouts = 0;               ///<rollouts completed (selections)
+    double seconds = 0;             ///<wall time of the search
+    double rolloutsPerSecond = 0;   ///<rollouts / seconds
+    long long nodesAllocated = 0;   ///<nodes created during the search
+    int maxDepth = 0;               ///<depth of the deepest simulated leaf
+    long long depthSum = 0;         ///<sum of the depths of the simulated leaves
+    long long simulations = 0;      ///<rollout simulations played
+    long long rolloutPlies = 0;     ///<moves played by the simulations
+    double selectionSeconds = 0;    ///<time spent descending the tree
+    double expansionSeconds = 0;    ///<time spent expanding nodes (without GP calls)
+    double gpSeconds = 0;           ///<time spent waiting for GP predictions on the search thread
+    double rolloutSeconds = 0;      ///<time spent in simulations (including GP rollout policy calls)
+    double backpropagationSeconds = 0;  ///<time spent backpropagating
+    int gpCalls = 0;                ///<Quoridor_GP::predict and predict_batch calls (and asynchronous requests)
+    int gpPositions = 0;            ///<positions evaluated by those calls
+    long long tacticalSearches = 0; ///<alpha-beta proofs run in sharp endgames (tacticalDepth)
+    long long tacticalProofs = 0;   ///<proofs that found a forced win
+
+
+    double averageDepth() const {
+        return rollouts ? (double) depthSum / rollouts : 0;
+    }
+
+
+    double averageRolloutLength() const {
+        return simulations ? (double) rolloutPlies / simulations : 0;
+    }
+
+
+    /**
+     * Adds the counters of another search (of a root parallel search), the wall time is left to the caller.
+     *
+     * @param other telemetry of the other search
+     * @return void
+     */
+    void add(const SearchStats& other){
+        rollouts += other.rollouts;
+        nodesAllocated += other.nodesAllocated;
+        maxDepth = max(maxDepth, other.maxDepth);
+        depthSum += other.depthSum;
+        simulations += other.simulations;
+        rolloutPlies += other.rolloutPlies;
+        selectionSeconds += other.selectionSeconds;
+        expansionSeconds += other.expansionSeconds;
+        gpSeconds += other.gpSeconds;
+        rolloutSeconds += other.rolloutSeconds;
+        backpropagationSeconds += other.backpropagationSeconds;
+        gpCalls += other.gpCalls;
+        gpPositions += other.gpPositions;
+        tacticalSearches += other.tacticalSearches;
+        tacticalProofs += other.tacticalProofs;
+    }
+
+
+    /**
+     * Prints the counters, one per line.
+     *
+     * @param out output stream
+     * @return void
+     */
+    void print(ostream& out = cout) const {
+        out << "rollouts: " << rollouts << " (" << rolloutsPerSecond << "/s in " << seconds << "s)\n"
+            << "nodes allocated: " << nodesAllocated << "\n"
+            << "depth: max " << maxDepth << ", average " << averageDepth() << "\n"
+            << "average rollout length: " << averageRolloutLength() << "\n"
+            << "selection: " << selectionSeconds << "s, expansion: " << expansionSeconds << "s, GP: " << gpSeconds
+            << "s, rollouts: " << rolloutSeconds << "s, backpropagation: " << backpropagationSeconds << "s\n"
+            << "GP calls: " << gpCalls << " (" << gpPositions << " positions)\n"
+            << "tactical searches: " << tacticalSearches << " (" << tacticalProofs << " proven)" << endl;
+    }
+};
+
+
+#if MCTS_TELEMETRY
+thread_local long long NODES_ALLOCATED = 0;    ///<nodes created by the current thread
+
+
+/**
+ * Adds the time until it goes out of scope to a counter.
+ */
+struct PhaseTimer {
+    double& seconds;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    PhaseTimer(double& seconds) : seconds(seconds) {}
+
+    ~PhaseTimer(){
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+};
+#endif
+
+
+/**
+ * Small and fast pseudo random number generator (xoshiro256**).
+ * Every search owns its own instance, so threads don't contend on the libc lock of rand()
+ * and a search is reproducible when it is seeded explicitly.
+ */
+class FastRandom
+{
+public:
+    uint64_t s[4];  ///<generator state
+
+
+    /**
+     * @param seed seed of the generator, 0: seed from the clock and the address of the generator
+     */
+    explicit FastRandom(uint64_t seed = 0){
+        this->seed(seed);
+    }
+
+
+    /**
+     * Seeds the generator, the state is filled by splitmix64.
+     *
+     * @param seed seed of the generator, 0: seed from the clock and the address of the generator
+     * @return void
+     */
+    void seed(uint64_t seed){
+        if(seed == 0){
+            seed = chrono::steady_clock::now().time_since_epoch().count() ^ (uint64_t) (uintptr_t) this;
+        }
+
+        for(int i = 0; i < 4; i++){
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+
+    inline uint64_t next(){
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+
+    /**
+     * Draws an integer uniformly from [0, n) by multiply-shift instead of a biased modulo.
+     *
+     * @param n upper bound (exclusive), must be positive
+     * @return uint32_t random integer
+     */
+    inline uint32_t below(uint32_t n){
+        return (uint32_t) (((next() >> 32) * n) >> 32);
+    }
+
+
+    /**
+     * @return double random number uniformly from [0, 1)
+     */
+    inline double uniform(){
+        return (next() >> 11) * 0x1.0p-53;
+    }
+
+
+private:
+    static inline uint64_t rotl(uint64_t x, int k){
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+
+#define ROLLOUT_LANES 32    // boards of a RolloutBatch
+#define PATH_BLOCKED 255    // distance of a pawn cut off from its goal
+
+typedef uint16_t LaneMask __attribute__((vector_size(2 * ROLLOUT_LANES)));  // one 9-bit row of cells per lane (SIMD vector)
+
+
+/**
+ * Boards of several rollouts, played in lockstep and stored as a structure of arrays (one entry per lane).
+ * The walls are kept as passage masks, one 9-bit row of cells per board row, held in SIMD vectors of all lanes,
+ * so the shortest paths of all lanes are found together by flooding the masks from the goal rows.
+ */
+class RolloutBatch
+{
+public:
+    int lanes = 0;  ///<number of boards in the batch
+
+    LaneMask openUp[9];     ///<bit j of row i is set if a pawn can step from (i, j) to (i + 1, j)
+    LaneMask openDown[9];   ///<bit j of row i is set if a pawn can step from (i, j) to (i - 1, j)
+    LaneMask openLeft[9];   ///<bit j of row i is set if a pawn can step from (i, j) to (i, j - 1)
+    LaneMask openRight[9];  ///<bit j of row i is set if a pawn can step from (i, j) to (i, j + 1)
+    bool takenWallPlaces[ROLLOUT_LANES][128];   ///<wall placements blocked by placed walls
+
+    uint8_t whitePawn[ROLLOUT_LANES];   ///<position of the white pawn (16 * i + j)
+    uint8_t blackPawn[ROLLOUT_LANES];   ///<position of the black pawn (16 * i + j)
+    uint8_t whiteWalls[ROLLOUT_LANES];  ///<walls in hand of white
+    uint8_t blackWalls[ROLLOUT_LANES];  ///<walls in hand of black
+    bool player[ROLLOUT_LANES];         ///<player to move, true: white, false: black
+    char winner[ROLLOUT_LANES];         ///<'w', 'b' or 0 while the rollout goes on
+
+    uint8_t distance[2][ROLLOUT_LANES]; ///<path lengths of the white [0] and black [1] pawns found by flood (PATH_BLOCKED if cut off)
+    uint8_t steps[2][ROLLOUT_LANES];    ///<steps of the pawns starting a shortest path found by flood (bits: up, down, left, right)
+
+
+    /**
+     * Empties the batch.
+     * 
+     * @return void
+     */
+    void clear(){
+        lanes = 0;
+    }
+
+
+    /**
+     * Adds a board to the batch.
+     * 
+     * @param board Board to play from    ASSUMPTION: no winner yet
+     * @param playerToMove true: white, false: black
+     * @return int Lane of the board
+     */
+    int add(Board& board, bool playerToMove){
+        int lane = lanes++;
+
+        for(int i = 0; i < 9; i++){
+            uint16_t up = 0, down = 0, left = 0, right = 0;
+            for(int j = 0; j < 9; j++){
+                uint8_t cell = 16 * i + j;
+                up |= (i < 8 && !board.walledOffCells[cell + UP]) << j;
+                down |= (i > 0 && !board.walledOffCells[cell + DOWN]) << j;
+                left |= (j > 0 && !board.walledOffCells[cell + LEFT]) << j;
+                right |= (j < 8 && !board.walledOffCells[cell + RIGHT]) << j;
+            }
+            openUp[i][lane] = up;
+            openDown[i][lane] = down;
+            openLeft[i][lane] = left;
+            openRight[i][lane] = right;
+        }
+        copy(begin(board.takenWallPlaces), end(board.takenWallPlaces), takenWallPlaces[lane]);
+
+        whitePawn[lane] = board.whitePawn;
+        blackPawn[lane] = board.blackPawn;
+        whiteWalls[lane] = board.whiteWalls;
+        blackWalls[lane] = board.blackWalls;
+        player[lane] = playerToMove;
+        winner[lane] = 0;
+        return lane;
+    }
+
+
+    /**
+     * Finds the path lengths and shortest path steps of both pawns in the active lanes (distance, steps).
+     * Both goal rows are flooded one step at a time in all lanes at once, a lane is done once it reached
+     * both pawns or stops growing.
+     * 
+     * @param active Lanes to flood
+     * @return void
+     */
+    void flood(const bool* active){
+        // Rows are offset by one, rows 0 and 10 stay empty, so the flood needs no bounds checks
+        LaneMask buffers[2][2][11] = {};
+        LaneMask (*reach)[11] = buffers[0];
+        LaneMask (*next)[11] = buffers[1];
+        bool pending[ROLLOUT_LANES];
+        int pendingLanes = 0;
+
+        for(int lane = 0; lane < ROLLOUT_LANES; lane++){
+            pending[lane] = lane < lanes && active[lane];
+            pendingLanes += pending[lane];
+            distance[0][lane] = distance[1][lane] = PATH_BLOCKED;
+            steps[0][lane] = steps[1][lane] = 0;
+            reach[0][9][lane] = 0x1ff;
+            reach[1][1][lane] = 0x1ff;
+        }
+
+        for(int lane = 0; lane < lanes; lane++){
+            // A pawn standing on its goal row has won, the flood is never asked about it
+            if(pending[lane] && (whitePawn[lane] >> 4) == 8){
+                distance[0][lane] = 0;
+            }
+            if(pending[lane] && (blackPawn[lane] >> 4) == 0){
+                distance[1][lane] = 0;
+            }
+        }
+
+        for(int step = 1; pendingLanes > 0; step++){
+            LaneMask grown = {};
+
+            for(int side = 0; side < 2; side++){
+                for(int i = 0; i < 9; i++){
+                    LaneMask row = reach[side][i + 1];
+                    LaneMask reached = row
+                        | ((row >> 1) & openRight[i])
+                        | ((row << 1) & openLeft[i])
+                        | (reach[side][i + 2] & openUp[i])
+                        | (reach[side][i] & openDown[i]);
+                    next[side][i + 1] = reached;
+                    grown |= reached ^ row;
+                }
+            }
+
+            for(int lane = 0; lane < lanes; lane++){
+                if(!pending[lane]){
+                    continue;
+                }
+
+                for(int side = 0; side < 2; side++){
+                    uint8_t pawn = side ? blackPawn[lane] : whitePawn[lane];
+                    int i = pawn >> 4;
+                    int j = pawn & 0xf;
+                    if(distance[side][lane] != PATH_BLOCKED || !((next[side][i + 1][lane] >> j) & 1)){
+                        continue;
+                    }
+
+                    // The steps into cells reached one flood step earlier start a shortest path
+                    distance[side][lane] = step;
+                    steps[side][lane] = (((openUp[i][lane] & reach[side][i + 2][lane]) >> j) & 1)
+                        | ((((openDown[i][lane] & reach[side][i][lane]) >> j) & 1) << 1)
+                        | ((((openLeft[i][lane] & (reach[side][i + 1][lane] << 1)) >> j) & 1) << 2)
+                        | ((((openRight[i][lane] & (reach[side][i + 1][lane] >> 1)) >> j) & 1) << 3);
+                }
+
+                bool found = distance[0][lane] != PATH_BLOCKED && distance[1][lane] != PATH_BLOCKED;
+                if(found || !grown[lane]){
+                    pending[lane] = false;
+                    pendingLanes--;
+                }
+            }
+
+            swap(reach, next);
+        }
+    }
+
+
+    /**
+     * Blocks the passages of a wall (takenWallPlaces is left to commitWall).
+     * 
+     * @param lane Lane of the board
+     * @param wallPlacement wallPlacement (no leading 1 -> between 0-127)
+     * @return void
+     */
+    void placeWall(int lane, uint8_t wallPlacement){
+        int i = (wallPlacement & 56) >> 3;
+        int j = wallPlacement & 7;
+
+        if(wallPlacement & 0x40){
+            openUp[i][lane] &= ~(3 << j);
+            openDown[i + 1][lane] &= ~(3 << j);
+        } else {
+            openRight[i][lane] &= ~(1 << j);
+            openRight[i + 1][lane] &= ~(1 << j);
+            openLeft[i][lane] &= ~(2 << j);
+            openLeft[i + 1][lane] &= ~(2 << j);
+        }
+    }
+
+
+    /**
+     * Reopens the passages of a wall rejected after placeWall.
+     * 
+     * @param lane Lane of the board
+     * @param wallPlacement wallPlacement (no leading 1 -> between 0-127)
+     * @return void
+     */
+    void removeWall(int lane, uint8_t wallPlacement){
+        int i = (wallPlacement & 56) >> 3;
+        int j = wallPlacement & 7;
+
+        if(wallPlacement & 0x40){
+            openUp[i][lane] |= 3 << j;
+            openDown[i + 1][lane] |= 3 << j;
+        } else {
+            openRight[i][lane] |= 1 << j;
+            openRight[i + 1][lane] |= 1 << j;
+            openLeft[i][lane] |= 2 << j;
+            openLeft[i + 1][lane] |= 2 << j;
+        }
+    }
+
+
+    /**
+     * Keeps a wall placed by placeWall, marks the places it takes and counts it for the player to move.
+     * 
+     * @param lane Lane of the board
+     * @param wallPlacement wallPlacement (no leading 1 -> between 0-127)
+     * @return void
+     */
+    void commitWall(int lane, uint8_t wallPlacement){
+        bool* taken = takenWallPlaces[lane];
+        int i = (wallPlacement & 56) >> 3;
+        int j = wallPlacement & 7;
+
+        taken[wallPlacement] = true;
+        if(wallPlacement & 0x40){
+            taken[wallPlacement - 0x40] = true;
+            if(j < 7) taken[wallPlacement + 1] = true;
+            if(j > 0) taken[wallPlacement - 1] = true;
+        } else {
+            taken[wallPlacement + 0x40] = true;
+            if(i < 7) taken[wallPlacement + 8] = true;
+            if(i > 0) taken[wallPlacement - 8] = true;
+        }
+
+        player[lane] ? whiteWalls[lane]-- : blackWalls[lane]--;
+    }
+
+
+    /**
+     * Moves the pawn of the player to move one step along a shortest path (found by flood).
+     * When the opponent stands on every such step, the pawn jumps over it, straight if it can, else sideways.
+     * 
+     * @param lane Lane of the board
+     * @param random Random number generator choosing among equally short steps
+     * @return void
+     */
+    void stepPawn(int lane, FastRandom& random){
+        static const int8_t offsets[4] = {16, -16, -1, 1};
+        bool white = player[lane];
+        uint8_t& pawn = white ? whitePawn[lane] : blackPawn[lane];
+        uint8_t opponent = white ? blackPawn[lane] : whitePawn[lane];
+        uint8_t shortest = steps[white ? 0 : 1][lane];
+
+        int first = random.below(4);
+        for(int k = 0; k < 4; k++){
+            int direction = (first + k) & 3;
+            if(((shortest >> direction) & 1) && pawn + offsets[direction] != opponent){
+                pawn += offsets[direction];
+                return;
+            }
+        }
+
+        for(int direction = 0; direction < 4; direction++){
+            if(!((shortest >> direction) & 1)){
+                continue;
+            }
+
+            if(isOpen(lane, opponent, direction)){
+                pawn = opponent + offsets[direction];
+                return;
+            }
+
+            // Up and down jump sideways to left and right, left and right jump to up and down
+            int side = direction < 2 ? 2 : 0;
+            for(int k = 0; k < 2; k++){
+                if(isOpen(lane, opponent, side + k)){
+                    pawn = opponent + offsets[side + k];
+                    return;
+                }
+            }
+        }
+
+        for(int direction = 0; direction < 4; direction++){
+            if(isOpen(lane, pawn, direction) && pawn + offsets[direction] != opponent){
+                pawn += offsets[direction];
+                return;
+            }
+        }
+    }
+
+
+private:
+    /**
+     * @param lane Lane of the board
+     * @param cell Cell (16 * i + j)
+     * @param direction 0: up, 1: down, 2: left, 3: right
+     * @return true if a pawn can step from @param cell in @param direction
+     */
+    inline bool isOpen(int lane, uint8_t cell, int direction){
+        int i = cell >> 4;
+        int j = cell & 0xf;
+        const LaneMask* open = direction == 0 ? openUp : direction == 1 ? openDown : direction == 2 ? openLeft : openRight;
+        return (open[i][lane] >> j) & 1;
+    }
+};
+
+class Node;
+
+
+/**
+ * Zobrist hashes of the position at a node, used for transposition lookups.
+ */
+struct PositionHash {
+    uint64_t hash;          ///<hash of the position
+    uint64_t mirroredHash;  ///<hash of the mirrored position
+    int ply;                ///<ply of the position, counted from the first root of the search tree
+};
+
+
+/**
+ * Transposition table, maps positions to the node shared by all parents reaching them.
+ * The ply is part of the key, so edges always point one ply deeper and the graph stays acyclic.
+ */
+class TranspositionTable
+{
+public:
+    unordered_map<uint64_t, Node*> nodes;   ///<nodes by key
+    bool foldMirrors = false;   ///<mirror-symmetric positions share a node
+
+
+    /**
+     * Calculates the key of a position.
+     *
+     * @param position hashes of the position
+     * @return key of the position
+     */
+    uint64_t key(const PositionHash& position) const {
+        uint64_t hash = foldMirrors ? min(position.hash, position.mirroredHash) : position.hash;
+        return hash ^ ZOBRIST.ply[position.ply & 0xff];
+    }
+
+
+    /**
+     * Looks up a node.
+     *
+     * @param key key of the position
+     * @return node of the position, nullptr if there is none
+     */
+    Node* find(uint64_t key) const {
+        auto it = nodes.find(key);
+        return it == nodes.end() ? nullptr : it->second;
+    }
+
+
+    void insert(uint64_t key, Node* node){
+        nodes[key] = node;
+    }
+
+
+    void erase(uint64_t key){
+        nodes.erase(key);
+    }
+
+
+    void clear(){
+        nodes.clear();
+    }
+};
+
+
 /**
  * Represents a node in the game tree for the Quoridor AI.
  * Each node contains game state information and MCTS statistics.
+ * With a transposition table nodes can be shared between parents, so they are reference counted.
+ * Children are registered in the table on their first visit, most children are never visited.
  */
 class Node
 {
 public:
     Node** children = nullptr;  ///<Pointers to children Nodes
-    Node* parent;   ///<Pointer to parent node
     bool player;    ///<player
     bool expanded;  ///<is node expanded
     int whiteWins;  ///<number of white wins simulated from the node
     int blackWins;  ///<number of black wins simulated from the node
     int heuristicValue; ///<heuristic value assigned to the node
+    float inverseVisits = 0;    ///<1 / number of simulations, kept up to date by addResults
+    float inverseSqrtVisits = 0;    ///<1 / sqrt(number of simulations), kept up to date by addResults
+    int references = 1; ///<number of parents (or owners) pointing to the node
+    int ply = 0;    ///<ply of the position (only used with a transposition table)
+    uint64_t hash = 0;  ///<Zobrist hash of the position in the orientation the node was registered in
+    uint64_t key = 0;   ///<transposition table key (0: not registered yet)
+
+    uint8_t* candidates = nullptr;  ///<unvalidated moves not yet materialized as children, ordered by prior (lazy expansion)
+    float* candidatePriors = nullptr;   ///<heuristic values of the candidates
+    int candidateCount = 0; ///<number of candidates
+    int nextCandidate = 0;  ///<index of the next candidate to materialize
+    int childCount = 0;     ///<number of materialized children
+
+    char provenWinner = 0;  ///<'w' / 'b' if the position is proven won by white / black, 0 if not proven
+    int provenLosses = 0;   ///<number of children proven lost for the player to move
+
+    int amafWhiteWins = 0;  ///<white wins of the simulations in which the move leading to the node was played later on (RAVE)
+    int amafBlackWins = 0;  ///<black wins of the simulations in which the move leading to the node was played later on (RAVE)
+
+
+    /**
+     * Expands the current node by generating its child nodes.
+     * Optionally calculates heuristics for children and weights them.
+     *
+     * @param board Pointer to the current board state
+     * @param heuristicsWeight Multiplier for heuristic value
+     * @param prior move distribution predicted by a model for @param board (nullptr: no heuristics)
+     * @param mirrored whether the node was created for the mirror image of @param board
+     * @return void
+     */
+    void expandNode(Board* board, int heuristicsWeight = 100, const VectorXd* prior = nullptr, bool mirrored = false){
+        uint8_t possibleMoves[256];
+        size_t moveCount = 0;
+        board->generatePossibleMoves(this->player, possibleMoves, moveCount);
+
+        // Do not want to preallocate, as that would result in a ~100x memory usage.
+        this->children = (Node**) malloc(256 * sizeof(Node*));
+
+        // Init to nullptr, so we avoid those nasty-nasty segfaults.
+        for(int i = 0; i < 256; i++){
+            this->children[i] = nullptr;
+        }
+
+        this->expanded = true;
+        this->childCount = moveCount;
+
+        if (prior) {
+            // Use GP prediction as heuristic
+            for(int i = 0; i < moveCount; i++){
+                uint8_t move = possibleMoves[i];
+                uint8_t child = mirrored ? Board::mirrorMove(move) : move;
+                this->children[child] = new Node(!this->player, (float) (*prior)(move) * heuristicsWeight);
+            }
+
+            return;
+        }
+
+        for(int i = 0; i < moveCount; i++){
+            uint8_t move = possibleMoves[i];
+            uint8_t child = mirrored ? Board::mirrorMove(move) : move;
+            this->children[child] = new Node(!this->player, 0);
+        }
+    }
+
+
+    /**
+     * Expands the current node lazily: moves are listed without validating walls and ordered by prior,
+     * children are only materialized (and validated) by widen.
+     *
+     * @param board Pointer to the current board state
+     * @param heuristicsWeight Multiplier for heuristic value
+     * @param prior move distribution predicted by a model for @param board (nullptr: moves are ordered by a cheap heuristic)
+     * @param mirrored whether the node was created for the mirror image of @param board
+     * @return void
+     */
+    void expandNodeLazily(Board* board, int heuristicsWeight = 100, const VectorXd* prior = nullptr, bool mirrored = false){
+        uint8_t possibleMoves[256];
+        size_t moveCount = 0;
+        board->generatePossibleMovesUnchecked(this->player, possibleMoves, moveCount);
+
+        this->children = (Node**) malloc(256 * sizeof(Node*));
+        for(int i = 0; i < 256; i++){
+            this->children[i] = nullptr;
+        }
+
+        this->expanded = true;
+
+        float order[256] = {0};
+        if (prior) {
+            for(size_t i = 0; i < moveCount; i++){
+                order[possibleMoves[i]] = (float) (*prior)(possibleMoves[i]);
+            }
+        } else {
+            // Shortest-path pawn move first, then other pawn moves, then probable wall placements
+            uint8_t probableWalls[256];
+            size_t probableWallCount = 0;
+            board->generateProbableWallPlacements(this->player, probableWalls, probableWallCount, false);
+            for(size_t i = 0; i < probableWallCount; i++){
+                order[probableWalls[i]] = 1;
+            }
+            for(size_t i = 0; i < moveCount && possibleMoves[i] < 128; i++){
+                order[possibleMoves[i]] = 2;
+            }
+            order[board->generateMoveOnShortestPath(this->player)] = 3;
+        }
+
+        // Ties keep the generation order, like stable_sort, which would allocate a buffer on every expansion
+        uint8_t generated[256];
+        for(size_t i = 0; i < moveCount; i++){
+            generated[possibleMoves[i]] = i;
+        }
+        sort(possibleMoves, possibleMoves + moveCount, [&order, &generated](uint8_t a, uint8_t b){
+            return order[a] != order[b] ? order[a] > order[b] : generated[a] < generated[b];
+        });
+
+        this->candidates = (uint8_t*) malloc(moveCount * sizeof(uint8_t));
+        this->candidatePriors = (float*) malloc(moveCount * sizeof(float));
+        this->candidateCount = moveCount;
+
+        for(size_t i = 0; i < moveCount; i++){
+            uint8_t move = possibleMoves[i];
+            this->candidates[i] = mirrored ? Board::mirrorMove(move) : move;
+            this->candidatePriors[i] = prior ? order[move] * heuristicsWeight : 0;
+        }
+    }
+
+
+    /**
+     * Materializes candidates (in prior order) until the node has the given number of children.
+     * Invalid wall placements are dropped here, when they are first considered.
+     *
+     * @param board Pointer to the current board state
+     * @param childLimit number of children the node should expose
+     * @param mirrored whether the node was created for the mirror image of @param board
+     * @return void
+     */
+    void widen(Board* board, int childLimit, bool mirrored = false){
+        while(this->childCount < childLimit && this->nextCandidate < this->candidateCount){
+            uint8_t child = this->candidates[this->nextCandidate];
+            float heuristicValue = this->candidatePriors[this->nextCandidate];
+            this->nextCandidate++;
+
+            uint8_t move = mirrored ? Board::mirrorMove(child) : child;
+            if(move >> 7 && !board->isValidWallPlacement(move & 0b01111111)){
+                continue;
+            }
+
+            this->children[child] = new Node(!this->player, heuristicValue);
+            this->childCount++;
+        }
+    }
+
+
+    /**
+     * Replaces the placeholder prior of an expanded node with a model's prediction.
+     * Children get their heuristic values, candidates not materialized yet are reordered by the prediction.
+     *
+     * @param prior move distribution predicted by a model for the position of the node
+     * @param heuristicsWeight Multiplier for heuristic value
+     * @param mirrored whether the node was created for the mirror image of the predicted board
+     * @return void
+     */
+    void applyPrior(const VectorXd& prior, int heuristicsWeight, bool mirrored = false){
+        for(int child = 0; child < 256; child++){
+            if(this->children[child]){
+                uint8_t move = mirrored ? Board::mirrorMove(child) : child;
+                this->children[child]->heuristicValue = (float) prior(move) * heuristicsWeight;
+            }
+        }
+
+        if(!this->candidates){
+            return;
+        }
+
+        for(int i = this->nextCandidate; i < this->candidateCount; i++){
+            uint8_t move = mirrored ? Board::mirrorMove(this->candidates[i]) : this->candidates[i];
+            this->candidatePriors[i] = (float) prior(move) * heuristicsWeight;
+        }
+
+        // Ties keep the current order (the index breaks them), stable_sort would allocate a buffer
+        tuple<float, int, uint8_t> remaining[256];
+        int remainingCount = this->candidateCount - this->nextCandidate;
+        for(int i = 0; i < remainingCount; i++){
+            remaining[i] = {this->candidatePriors[this->nextCandidate + i], i, this->candidates[this->nextCandidate + i]};
+        }
+
+        sort(remaining, remaining + remainingCount, [](const tuple<float, int, uint8_t>& a, const tuple<float, int, uint8_t>& b){
+            return get<0>(a) != get<0>(b) ? get<0>(a) > get<0>(b) : get<1>(a) < get<1>(b);
+        });
+
+        for(int i = 0; i < remainingCount; i++){
+            this->candidatePriors[this->nextCandidate + i] = get<0>(remaining[i]);
+            this->candidates[this->nextCandidate + i] = get<2>(remaining[i]);
+        }
+    }
+
+
+    /**
+     * Updates the proof of the node from its children (MCTS-Solver):
+     * the node is won if any child is won for the player to move, and lost if every move is proven lost.
+     *
+     * @return bool Whether the node is proven
+     */
+    bool updateProof(){
+        char mover = this->player ? 'w' : 'b';
+        char opponent = this->player ? 'b' : 'w';
+
+        int losses = 0;
+        bool allLost = true;
+        for(int move = 0; move < 256; move++){
+            Node* child = this->children[move];
+            if(!child){
+                continue;
+            }
+
+            if(child->provenWinner == mover){
+                this->provenWinner = mover;
+                return true;
+            }
+
+            if(child->provenWinner == opponent){
+                losses++;
+            } else {
+                allLost = false;
+            }
+        }
+        this->provenLosses = losses;
+
+        // With lazy expansion the candidates not materialized yet may still hold a saving move
+        if(allLost && losses && this->nextCandidate >= this->candidateCount){
+            this->provenWinner = opponent;
+            return true;
+        }
+        return false;
+    }
+
+
+    /**
+     * Calculates the UCT value of the node based on MCTS and heuristic evaluation.
+     *
+     * @param player Perspective of the player (true = white, false = black)
+     * @param mctsParameter Exploration constant used in UCT formula
+     * @param parentSqrtLogVisits sqrt(log(n_parent)) of the parent the node is selected from
+     * @param raveEquivalence RAVE equivalence parameter k, the AMAF value is weighted by sqrt(k / (3n + k)) (0: no RAVE)
+     * @return float Value of the node
+     */
+    inline float getValue(bool player, float mctsParameter, float parentSqrtLogVisits, float raveEquivalence = 0){
+        if (this->whiteWins + this->blackWins == 0){
+            return -1;
+        }
+
+        float wins = (float)(player ? whiteWins : blackWins);
+        float value = (this->heuristicValue + wins) * inverseVisits;
+
+        int amafVisits = this->amafWhiteWins + this->amafBlackWins;
+        if (raveEquivalence > 0 && amafVisits){
+            float amafValue = (float)(player ? amafWhiteWins : amafBlackWins) / amafVisits;
+            float beta = sqrt(raveEquivalence / (3 * (this->whiteWins + this->blackWins) + raveEquivalence));
+            value = (1 - beta) * value + beta * amafValue;
+        }
+
+        return value + mctsParameter * parentSqrtLogVisits * inverseSqrtVisits;
+    }
+
+
+    /**
+     * Adds simulation results to the node and updates the cached reciprocal visit terms.
+     *
+     * @param whiteWins Number of white wins to add
+     * @param blackWins Number of black wins to add
+     * @return void
+     */
+    inline void addResults(int whiteWins, int blackWins){
+        this->whiteWins += whiteWins;
+        this->blackWins += blackWins;
+
+        int visits = this->whiteWins + this->blackWins;
+        this->inverseVisits = visits ? 1.0f / visits : 0;
+        this->inverseSqrtVisits = UCT_TABLES.inverseSqrtOf(visits);
+    }
+
+
+    /**
+     * Node constructor
+     * 
+     * @param player true: white's turn, false: black's turn
+     * @param heuristicValue Heuristic value assigned to this node
+     */
+    Node(bool player, float heuristicValue){
+        TELEMETRY(NODES_ALLOCATED++;)
+        this->player = player;
+        this->expanded = false;
+        this->whiteWins = 0;
+        this->blackWins = 0;
+        this->heuristicValue = heuristicValue;
+    }
+
+
+    /**
+     * Turns an expanded node whose children are all leaves back into a leaf and frees the children.
+     * The statistics of the node are kept, so the simulations of the subtree stay folded into the edge from its parent,
+     * and the node is expanded again if it is selected later on.
+     *
+     * @param transpositions transposition table the freed children are removed from
+     * @return int Number of nodes freed (children shared with other parents are kept)
+     */
+    int collapse(TranspositionTable& transpositions){
+        int freed = 0;
+        for(int i = 0; i < 256; i++){
+            Node* child = this->children[i];
+            if(child && --child->references == 0){
+                if(child->key){
+                    transpositions.erase(child->key);
+                }
+                delete child;
+                freed++;
+            }
+        }
+
+        free(this->children);
+        free(this->candidates);
+        free(this->candidatePriors);
+        this->children = nullptr;
+        this->candidates = nullptr;
+        this->candidatePriors = nullptr;
+        this->candidateCount = 0;
+        this->nextCandidate = 0;
+        this->childCount = 0;
+        this->provenLosses = 0;
+        this->expanded = false;
+        return freed;
+    }
+
+
+    /**
+     * Node destructor
+     * Recursively deletes all child nodes that are not shared with other parents and frees memory
+     */
+    ~Node() {
+        if(!this->children){
+            return;
+        }
+
+        for(int i = 0; i < 256; i++){
+            Node* child = this->children[i];
+            if(child && --child->references == 0){
+                delete child;
+            }
+        }
+
+        // Free the array of child pointers, 
+        // Yes, it has been pointed out, that I should've used new and delete instead 
+        // Yes, I tried to use a malloc-delete combination, compiler did not catch it, but it obviously did not work
+        free(this->children); 
+        free(this->candidates);
+        free(this->candidatePriors);
+    }
+};
+
+
+/**
+ * Leaf selected by the search, waiting for its GP prior before it is expanded.
+ */
+struct PendingLeaf {
+    Node* node;             ///<the leaf
+    Board board;            ///<board at the leaf
+    PositionHash position;  ///<hashes of the position at the leaf
+    int depth;              ///<depth of the leaf
+    Quoridor_GP* model;     ///<model predicting the prior
+    vector<Node*> path;     ///<nodes from the root to the leaf (carrying a virtual loss)
+    vector<uint8_t> moves;  ///<moves played along path
+    vector<bool> mirrored;  ///<whether the nodes of path were entered mirrored
+
+
+    PendingLeaf(){
+        path.reserve(SEARCH_PATH_CAPACITY);
+        moves.reserve(SEARCH_PATH_CAPACITY);
+        mirrored.reserve(SEARCH_PATH_CAPACITY);
+    }
+};
+
+
+/**
+ * Leaf whose rollouts are played in the lanes of a RolloutBatch.
+ */
+struct LockstepLeaf {
+    Node* node;             ///<the leaf
+    vector<Node*> path;     ///<nodes from the root to the leaf (carrying a virtual loss)
+    int lane;               ///<first lane of the rollouts of the leaf
+
+
+    LockstepLeaf(){
+        path.reserve(SEARCH_PATH_CAPACITY);
+    }
+};
+
+
+/**
+ * Preallocated buffers of the hot path of a search. They are kept between iterations and only grow,
+ * so steady-state rollouts and expansions do not allocate apart from the nodes the tree grows by.
+ */
+struct SearchScratch {
+    gp_scratch gp;                  ///<buffers of the GP predictions
+    input_vector input;             ///<input vector of a single prediction
+    vector<input_vector> inputs;    ///<input vectors of a batch of predictions
+    vector<int> batch;              ///<pending leaves of the batch being predicted
+    vector<bool> evaluated;         ///<pending leaves whose prior has been predicted
+    VectorXd prior;                 ///<prior handed to expandLeaf
+};
+
+
+/**
+ * GP prior requested for a node expanded with a placeholder prior.
+ */
+struct PriorRequest {
+    Node* node;             ///<expanded node (the request holds a reference to it)
+    Quoridor_GP* model;     ///<model predicting the prior
+    input_vector input;     ///<input vector of the position at the node
+    int heuristicsWeight;   ///<multiplier for the predicted prior
+    bool mirrored;          ///<whether the node was created for the mirror image of the position
+};
+
+
+/**
+ * Prior evaluated for a request.
+ */
+struct PriorResult {
+    PriorRequest request;   ///<the request
+    VectorXd prior;         ///<predicted move distribution
+};
+
+
+/**
+ * Evaluates GP priors on a dedicated thread, so the search does not wait for them.
+ * Requests queued while the previous ones were evaluated are evaluated together, one matrix product per model.
+ * Only the search thread touches the nodes, the evaluator only reads the input vectors and the models.
+ */
+class PriorEvaluator
+{
+public:
+    PriorEvaluator(){
+        worker = thread([this](){
+            run();
+        });
+    }
+
+
+    ~PriorEvaluator(){
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+
+    /**
+     * Queues a request.
+     *
+     * @param request prior requested
+     * @return void
+     */
+    void request(const PriorRequest& request){
+        {
+            lock_guard<mutex> lock(queueMutex);
+            requests.push_back(request);
+            outstanding++;
+        }
+        wake.notify_one();
+    }
+
+
+    /**
+     * Moves the results evaluated so far to @param out (without waiting).
+     *
+     * @param out results
+     * @return void
+     */
+    void collect(vector<PriorResult>& out){
+        lock_guard<mutex> lock(queueMutex);
+        for(PriorResult& result : results){
+            out.push_back(move(result));
+        }
+        results.clear();
+    }
+
+
+    /**
+     * Waits until every request is evaluated, and moves the results to @param out.
+     *
+     * @param out results
+     * @return void
+     */
+    void collectAll(vector<PriorResult>& out){
+        {
+            unique_lock<mutex> lock(queueMutex);
+            finished.wait(lock, [this](){ return outstanding == 0; });
+        }
+        collect(out);
+    }
+
+
+private:
+    thread worker;  ///<evaluator thread
+    mutex queueMutex;   ///<guards the members below
+    condition_variable wake;    ///<signals new requests (or stopping) to the worker
+    condition_variable finished;    ///<signals that the outstanding requests are evaluated
+    vector<PriorRequest> requests;  ///<requests waiting for evaluation
+    vector<PriorResult> results;    ///<evaluated requests waiting to be collected
+    int outstanding = 0;    ///<requests queued or being evaluated
+    bool stopping = false;  ///<the worker should exit
+
+
+    void run(){
+        vector<PriorRequest> batch;
+        vector<PriorResult> evaluated;
+        vector<input_vector> inputs;
+
+        while(true){
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wake.wait(lock, [this](){ return stopping || !requests.empty(); });
+                if(stopping){
+                    return;
+                }
+                batch.swap(requests);
+            }
+
+            vector<bool> done(batch.size(), false);
+            for(size_t i = 0; i < batch.size(); i++){
+                if(done[i]){
+                    continue;
+                }
+
+                inputs.clear();
+                vector<int> indices;
+                for(size_t j = i; j < batch.size(); j++){
+                    if(!done[j] && batch[j].model == batch[i].model){
+                        inputs.push_back(batch[j].input);
+                        indices.push_back(j);
+                        done[j] = true;
+                    }
+                }
+
+                MatrixXd priors = batch[i].model->predict_batch(inputs);
+                for(size_t b = 0; b < indices.size(); b++){
+                    evaluated.push_back({batch[indices[b]], priors.row(b).transpose()});
+                }
+            }
+
+            {
+                lock_guard<mutex> lock(queueMutex);
+                for(PriorResult& result : evaluated){
+                    results.push_back(move(result));
+                }
+                outstanding -= batch.size();
+            }
+            finished.notify_all();
+
+            batch.clear();
+            evaluated.clear();
+        }
+    }
+};
+
+
+/**
+ * Minimax agent
+ */
+class Minimax {
+    public:
+
+    int minmaxDepth;    ///<depth of minimax search
+
+    /**
+     * Does minimax with alpha-beta pruning
+     * 
+     * @param board board
+     * @param depth simulation depth
+     * @param player true: white, false: black
+     * @param alpha alpha value
+     * @param beta beta value
+     * return minimax value
+     */
+    float minimax(Board* board, int depth, bool player, float alpha, float beta){
+    
+        if (depth == 0){
+            return board->evaluate();
+        }
+    
+        if(player){
+            float maxValue = -1000.0f;
+            uint8_t moves[256] = {0};
+            size_t movesCount = 0; 
+            board->generatePossibleMoves(player, moves, movesCount);
+            
+            for (size_t i = 0; i < movesCount; i++){
+                uint8_t move = moves[i];
+    
+                board->executeMove(move, player);
+                maxValue = max(maxValue, minimax(board, depth - 1, !player, alpha, beta));
+                board->undoMove(move, player);
+    
+                alpha = max(alpha, maxValue);
+    
+                if (maxValue > beta){
+                    break;
+                }
+            }
+            return maxValue;
+        }
+    
+        if(!player){
+            float minValue = 1000.0f;
+            uint8_t moves[256] = {0};
+            size_t movesCount = 0; 
+            board->generatePossibleMoves(player, moves, movesCount);
+            
+            for (size_t i = 0; i < movesCount; i++){
+                uint8_t move = moves[i];
+    
+                board->executeMove(move, player);
+                minValue = min(minValue, minimax(board, depth - 1, !player, alpha, beta));
+                board->undoMove(move, player);
+    
+                beta = min(beta, minValue);
+    
+                if(minValue < alpha){
+                    break;
+                }
+            }
+            return minValue;
+        }
+    
+        return 0;
+    }
+    
+
+    /**
+     * Predicts best move for a given board position and player
+     * 
+     * @param board board
+     * @param depth simulation depth
+     * return predicted best move
+     */
+    uint8_t predictBestMove(Board* board, bool player){
+        int depth = minmaxDepth;
+        uint8_t bestMove;
+    
+        float alpha = -2000.0f;
+        float beta = 2000.0f;
+    
+        if (depth == 0){
+            return board->evaluate();
+        }
+    
+        if(player){
+            float maxValue = -2000.0f;
+    
+            uint8_t moves[256] = {0};
+            size_t movesCount = 0; 
+            board->generatePossibleMoves(player, moves, movesCount);
+            
+            for (size_t i = 0; i < movesCount; i++){
+                uint8_t move = moves[i];
+    
+                board->executeMove(move, player);
+                float value = minimax(board, depth - 1, !player, alpha, beta);
+                if(value > maxValue){
+                    bestMove = move;
+                    maxValue = value;
+                }
+                board->undoMove(move, player);
+                alpha = max(alpha, maxValue);
+    
+                if (maxValue > beta){
+                    break;
+                }
+            }
+        }
+    
+        if(!player){
+            float minValue = 2000.0f;
+    
+            uint8_t moves[256] = {0};
+            size_t movesCount = 0;
+            board->generatePossibleMoves(player, moves, movesCount);
+            
+            for (size_t i = 0; i < movesCount; i++){
+                uint8_t move = moves[i];
+                board->executeMove(move, player);
+                float value = minimax(board, depth - 1, !player, alpha, beta);
+                if(value < minValue){
+                    bestMove = move;
+                    minValue = value;
+                }
+                board->undoMove(move, player);
+                beta = min(beta, minValue);
+    
+                if(minValue < alpha){
+                    break;
+                }
+            }
+        }
+    
+        
+        return bestMove;
+    }
+
+
+    /**
+     * Proves a position with alpha-beta limited to finished games (minmaxDepth plies, no evaluation).
+     *
+     * @param board board
+     * @param player player to move, true: white, false: black
+     * return 1 if the player to move forces a win, -1 if the opponent does, 0 if not proven within the depth
+     */
+    int provePosition(Board* board, bool player){
+        return prove(board, minmaxDepth, player, -1, 1);
+    }
+
+
+    /**
+     * Negamax with alpha-beta pruning over the results of finished games (see provePosition).
+     * Pawn moves are tried first, walls are only generated if no pawn move cut off the search,
+     * and not at all on the last ply, where only a pawn move can finish the game.
+     *
+     * @param board board
+     * @param depth remaining plies
+     * @param player player to move, true: white, false: black
+     * @param alpha alpha value
+     * @param beta beta value
+     * return 1 / -1 / 0 for a win / loss / unknown of the player to move
+     */
+    int prove(Board* board, int depth, bool player, int alpha, int beta){
+        uint8_t moves[256];
+        size_t movesCount = 0;
+        board->generatePossiblePawnMoves(player, moves, movesCount);
+        size_t pawnMoves = movesCount;
+
+        int bestValue = -1;
+        for(size_t i = 0; i < movesCount; i++){
+            uint8_t move = moves[i];
+
+            board->executeMove(move, player);
+            int value = board->getWinner() ? 1 : (depth > 1 ? -prove(board, depth - 1, !player, -beta, -alpha) : 0);
+            board->undoMove(move, player);
+
+            bestValue = max(bestValue, value);
+            alpha = max(alpha, bestValue);
+            if(alpha >= beta){
+                return bestValue;
+            }
+
+            if(i + 1 == pawnMoves && depth > 1){
+                board->generatePossibleWallPlacements(player, moves, movesCount);
+            }
+        }
+        return bestValue;
+    }
+
+    /**
+     * Minimax constructor
+     */
+    Minimax(int minimaxDepth){
+        this->minmaxDepth = minimaxDepth;
+    }
+
+};
+
+
+/**
+ * Search result of a position stored in an AnalysisCache.
+ */
+struct AnalysisEntry {
+    uint64_t key;           ///<Zobrist hash of the position with the player to move, lowest bit set (0: empty slot)
+    uint64_t fingerprint;   ///<fingerprint of the search parameters (see MCTS::searchFingerprint)
+    int32_t rollouts;       ///<rollout budget the visits stand for
+    uint8_t complete;       ///<1 if the whole budget was searched, 0 if the search stopped once decided
+    uint8_t bestMove;       ///<move chosen by the search
+    uint8_t position[32];   ///<Board::getSaveData of the position, guards against hash collisions
+    int32_t visits[256];    ///<visits of the moves at the root
+};
+
+
+/**
+ * Header of an AnalysisCache file, followed by the entry slots.
+ */
+struct AnalysisCacheHeader {
+    uint64_t magic;         ///<ANALYSIS_CACHE_MAGIC
+    uint64_t entrySize;     ///<sizeof(AnalysisEntry) of the program that created the file
+    uint64_t capacity;      ///<number of entry slots
+};
+
+
+/**
+ * Persistent cache of search results (root visits) keyed by position, kept in a memory-mapped file.
+ * The file is a hash table with a fixed number of slots, an entry lives in one of ANALYSIS_CACHE_PROBES slots after
+ * the slot of its hash, and replaces the entry searched with the fewest rollouts when they are all taken.
+ * Each position has one entry, a search with other parameters overwrites it.
+ * A file is used by one process at a time, it is locked while open and a second process finds the cache closed.
+ */
+class AnalysisCache
+{
+public:
+    int minRollouts = 1000; ///<entries searched with fewer rollouts are not reused
+    bool matchFingerprint = true;   ///<only reuse entries searched with the same parameters
+
+
+    /**
+     * Opens a cache file, creating it with @param capacity slots if it does not exist.
+     * A file of another format is left alone and the cache stays closed (see isOpen), so does a file another process has open.
+     *
+     * @param path path of the cache file
+     * @param capacity number of entry slots of a new file
+     */
+    AnalysisCache(const string& path, uint64_t capacity = 16384){
+        file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if(file < 0){
+            return;
+        }
+
+        // Concurrent stores could tear an entry, whose mixed visits would still pass lookup
+        if(flock(file, LOCK_EX | LOCK_NB) != 0){
+            close(file);
+            file = -1;
+            return;
+        }
+
+        AnalysisCacheHeader stored = {};
+        bool created = pread(file, &stored, sizeof(stored), 0) != (ssize_t) sizeof(stored);
+        if(!created){
+            if(stored.magic != ANALYSIS_CACHE_MAGIC || stored.entrySize != sizeof(AnalysisEntry) || !stored.capacity){
+                return;
+            }
+            capacity = stored.capacity;
+        }
+
+        mappedSize = sizeof(AnalysisCacheHeader) + capacity * sizeof(AnalysisEntry);
+        if(created ? ftruncate(file, mappedSize) != 0 : lseek(file, 0, SEEK_END) < (off_t) mappedSize){
+            return;
+        }
+
+        void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if(mapped == MAP_FAILED){
+            return;
+        }
+
+        header = (AnalysisCacheHeader*) mapped;
+        entries = (AnalysisEntry*) (header + 1);
+        if(created){
+            header->entrySize = sizeof(AnalysisEntry);
+            header->capacity = capacity;
+            header->magic = ANALYSIS_CACHE_MAGIC;
+        }
+    }
+
+
+    AnalysisCache(const AnalysisCache&) = delete;
+    AnalysisCache& operator=(const AnalysisCache&) = delete;
+
+
+    ~AnalysisCache(){
+        if(header){
+            munmap(header, mappedSize);
+        }
+        if(file >= 0){
+            close(file);
+        }
+    }
+
+
+    bool isOpen() const {
+        return header;
+    }
+
+
+    /**
+     * Looks up the search result of a position that the reuse rules allow.
+     *
+     * @param board board position
+     * @param player player to move, true: white, false: black
+     * @param fingerprint fingerprint of the parameters of the search asking
+     * @param requireComplete whether only results of a whole rollout budget are useful
+     * @return the entry, nullptr if there is none to reuse
+     */
+    const AnalysisEntry* lookup(Board& board, bool player, uint64_t fingerprint, bool requireComplete){
+        if(!header){
+            return nullptr;
+        }
+
+        uint8_t position[32] = {0};
+        board.getSaveData(position);
+        AnalysisEntry* entry = find(board.zobristHash(player) | 1, position);
+        if(!entry || !entry->key || entry->rollouts < minRollouts){
+            return nullptr;
+        }
+        if((matchFingerprint && entry->fingerprint != fingerprint) || (requireComplete && !entry->complete)){
+            return nullptr;
+        }
+        return entry;
+    }
+
+
+    /**
+     * Stores the search result of a position.
+     *
+     * @param board board position
+     * @param player player to move, true: white, false: black
+     * @param fingerprint fingerprint of the search parameters
+     * @param rollouts rollout budget of the search
+     * @param complete whether the whole budget was searched
+     * @param bestMove move chosen by the search
+     * @param visits visits of the moves at the root (256 entries)
+     * @return void
+     */
+    void store(Board& board, bool player, uint64_t fingerprint, int rollouts, bool complete, uint8_t bestMove, const int* visits){
+        if(!header){
+            return;
+        }
+
+        uint8_t position[32] = {0};
+        board.getSaveData(position);
+        uint64_t key = board.zobristHash(player) | 1;
+        AnalysisEntry* entry = find(key, position);
+        if(!entry){
+            // Every slot is taken by another position, the least searched one is replaced
+            entry = &entries[key % header->capacity];
+            for(int probe = 1; probe < ANALYSIS_CACHE_PROBES; probe++){
+                AnalysisEntry* slot = &entries[(key + probe) % header->capacity];
+                if(slot->rollouts < entry->rollouts){
+                    entry = slot;
+                }
+            }
+        }
+
+        entry->key = key;
+        entry->fingerprint = fingerprint;
+        entry->rollouts = rollouts;
+        entry->complete = complete;
+        entry->bestMove = bestMove;
+        memcpy(entry->position, position, sizeof(position));
+        memcpy(entry->visits, visits, sizeof(entry->visits));
+    }
+
+private:
+    int file = -1;  ///<descriptor of the cache file
+    size_t mappedSize = 0;  ///<bytes mapped
+    AnalysisCacheHeader* header = nullptr;  ///<mapped file, nullptr if the cache is not open
+    AnalysisEntry* entries = nullptr;   ///<entry slots of the mapped file
+
+
+    /**
+     * Finds the slot of a position, or the first empty slot it may be stored in.
+     *
+     * @param key key of the position
+     * @param position Board::getSaveData of the position
+     * @return the slot, nullptr if the position is not stored and there is no empty slot
+     */
+    AnalysisEntry* find(uint64_t key, const uint8_t* position){
+        for(int probe = 0; probe < ANALYSIS_CACHE_PROBES; probe++){
+            AnalysisEntry* slot = &entries[(key + probe) % header->capacity];
+            if(!slot->key || (slot->key == key && !memcmp(slot->position, position, position[0]))){
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+};
+
+
+/**
+ * Result of one worker process of a root parallel search, kept in memory shared with the coordinator.
+ */
+struct RootWorkerSlot {
+    bool finished;              ///<set by the worker once the rest of the slot is written
+    uint8_t bestMove;           ///<move chosen by the worker's own search
+    int rolloutsSaved;          ///<rollouts left unused by early termination
+    int expectedRollouts;       ///<rollouts the worker's next search would derive its prior weights from
+    SearchStats stats;          ///<telemetry of the worker's search
+    int visits[256];            ///<visits of the moves at the root
+    char provenWinners[256];    ///<proven winner of the children of the root ('w', 'b', 0: not proven)
+};
+
+
+/**
+ * MCTS agent
+ */
+class MCTS
+{
+    public: 
+
+    Quoridor_GP whiteModels[21] = {};   ///<GP models used for white nodes
+    Quoridor_GP blackModels[21] = {};   ///<GP models used for black nodes
+    Quoridor_GP smallWhiteModels[21] = {};  ///<GP models used for white nodes (small)
+    Quoridor_GP smallBlackModels[21] = {};  ///<GP models used for black nodes (small)
+
+    int rollouts = 50000;   ///<number of rollouts
+    int timeBudget = 0;     ///<time budget per decision in milliseconds (0: search for a fixed number of rollouts)
+    int timeCheckInterval = 16; ///<rollouts between two clock reads in time budgeted search
+    bool earlyStop = true;  ///<end the search of a decision once the most visited move can no longer change
+    int earlyStopInterval = 64; ///<rollouts between two early termination checks
+    int rolloutsSaved = 0;  ///<rollouts left unused by early termination in the last search (estimated in time budgeted search)
+    SearchStats stats;  ///<telemetry of the last search (only collected with MCTS_TELEMETRY)
+    long long nodeBudget = 0;   ///<maximum number of nodes in the tree, beyond it the least visited subtrees are collapsed (0: no limit)
+    float pruneTarget = 0.75;   ///<pruning shrinks the tree to this fraction of nodeBudget
+    long long treeNodes = 0;    ///<number of nodes in the tree being searched
+    int expectedRollouts = 50000;   ///<rollouts the expansion prior weights are derived from
+    int simulationsPerRollout = 3;  ///<simulations per rollout
+
+    float mctsParameter = 0.25; ///<mcts parameter (c)
+    int rolloutPolicyParameter = 4; ///<rollout policy parameter
+
+    string modelDirectory = "GPmodels"; ///<directory of GP model save files
+    bool useModelForUCT = true; ///<model usage for UCT
+    int rolloutPolicyFunction = 2;  ///<rollout policy function used
+    int rolloutCutoff = 0;  ///<plies after which a rollout stops and its result is drawn from an evaluation (0: full rollouts)
+    float cutoffMargin = 4; ///<a truncated rollout also stops as soon as a side leads by this many plies
+    float cutoffScale = 2;  ///<lead (in plies) at which the evaluation gives the leading side a 73% win probability
+    float cutoffWallValue = 1.5;    ///<plies of lead a wall in hand is worth in the evaluation
+    bool decisiveRollouts = true;   ///<rollouts play winning pawn moves at once, and turn a wall played while the opponent is about to win into one stopping them (see decisiveMove)
+    int tacticalDepth = 0;  ///<plies of the alpha-beta proving new leaves in sharp endgames, proven leaves skip their rollouts (0: off)
+    bool tacticalRollouts = false;  ///<also end rollouts reaching a sharp endgame with that proof (requires tacticalDepth)
+    bool lockstepRollouts = false;  ///<play the rollouts of several leaves together in a RolloutBatch (see playLockstep, only with rolloutPolicyFunction 2 and without rave or decisiveRollouts)
+    bool reuseTree = true;  ///<keep the search tree between consecutive decisions
+    bool useTranspositions = true;  ///<share nodes of positions reached by different move orders
+    bool foldMirrors = false;   ///<share nodes of mirror-symmetric positions as well (requires useTranspositions)
+    bool progressiveWidening = true;    ///<expand lazily and expose children gradually
+    float wideningFactor = 2.0; ///<a node with n visits exposes wideningFactor * n^wideningExponent children
+    float wideningExponent = 0.5;   ///<see wideningFactor
+    int rootWorkers = 1;    ///<processes searching the root in parallel, their visits are merged (see searchRootParallel, 1: search in this process)
+
+    TranspositionTable transpositions;  ///<transposition table of the tree being searched
+    PositionHash rootPosition;  ///<hashes of the position at the root of the tree being searched
+    vector<Node*> searchPath;   ///<nodes visited by the current selection, used for backpropagation
+    vector<uint8_t> searchMoves;    ///<moves played by the current selection (searchMoves[i] leaves searchPath[i])
+    vector<bool> searchMirrored;    ///<whether searchPath[i] was entered mirrored (indexes its children by mirrored moves)
+    bool rave = false;  ///<blend AMAF statistics of the moves into the node values (RAVE)
+    float raveEquivalence = 200;    ///<number of visits at which the AMAF value and the node's own value weigh about the same
+    vector<uint8_t> raveMoves;  ///<moves of the current simulation from the root (used by RAVE)
+    int priorBatchSize = 8; ///<leaves whose GP priors are evaluated together in one matrix product (1: evaluate each leaf on its own)
+    vector<PendingLeaf> pendingLeaves;  ///<leaves of the current batch waiting for their GP prior (entries past pendingCount are kept for reuse)
+    int pendingCount = 0;   ///<number of leaves in pendingLeaves
+    RolloutBatch rolloutBatch;  ///<boards of the lockstep rollouts of the current batch
+    vector<LockstepLeaf> lockstepLeaves;    ///<leaves of the current batch whose rollouts are in rolloutBatch (entries past lockstepCount are kept for reuse)
+    int lockstepCount = 0;  ///<number of leaves in lockstepLeaves
+    SearchScratch scratch;  ///<preallocated buffers of the hot path
+    bool eagerChildPriors = false;  ///<predict the priors of all children of the root in one batch when it is expanded (see predictChildPriors)
+    MatrixXd childPriors;   ///<priors predicted by predictChildPriors, one row per position
+    unordered_map<uint64_t, int> childPriorRows;    ///<rows of childPriors by Zobrist hash of the position
+    bool asyncPriors = false;   ///<expand with a placeholder prior and evaluate the GP prior on a separate thread (replaces batching)
+    unique_ptr<PriorEvaluator> priorEvaluator;  ///<evaluator thread of asyncPriors (started on first use)
+    vector<PriorResult> priorResults;   ///<evaluated priors not applied yet
+    FastRandom random;  ///<random number generator of the rollouts (seed it for reproducible searches)
+    unique_ptr<AnalysisCache> analysisCache;    ///<persistent cache of searched positions (see openAnalysisCache)
+
+    unique_ptr<Node> searchTree;    ///<search tree kept between decisions (only used with reuseTree)
+    Board searchTreeBoard;  ///<board position at the root of searchTree
+
+    bool ponder = false;    ///<keep searching on the opponent's time (requires reuseTree)
+    int ponderRollouts = 200000;    ///<maximum number of rollouts spent pondering (bounds memory usage)
+    thread ponderThread;    ///<background thread searching on the opponent's time
+    unique_ptr<atomic<bool>> ponderStop = make_unique<atomic<bool>>(false);   ///<signals ponderThread to stop
+
+    /**
+     * Loads in all the GP models from the model directory
+     * 
+     * @param modelDirectory the directory of the models
+     * @return void
+     */
+    void loadModels() {
+        if (modelDirectory == ""){
+            return;
+        }
+        
+        std::filesystem::path modelDir = std::filesystem::absolute(modelDirectory);
+    
+        for (int i = 0; i < 21; i++) {
+            whiteModels[i] = Quoridor_GP::load((modelDir / ("whiteModel" + to_string(i))).string());
+            blackModels[i] = Quoridor_GP::load((modelDir / ("blackModel" + to_string(i))).string());
+            smallWhiteModels[i] = Quoridor_GP::load((modelDir / ("whiteModelSmall" + to_string(i))).string());
+            smallBlackModels[i] = Quoridor_GP::load((modelDir / ("blackModelSmall" + to_string(i))).string());
+        }
+    }
+
+
+    /**
+     * Opens (or creates) a persistent analysis cache.
+     * Searches with a rollout budget then return the cached result of a position searched with at least as many rollouts,
+     * and search again (replacing it) a position searched with fewer.
+     * 
+     * @param path Path of the cache file
+     * @param capacity Number of positions a new cache file holds
+     * @return bool Whether the cache could be opened (not while another process has the file open)
+     */
+    bool openAnalysisCache(const string& path, uint64_t capacity = 16384){
+        // The lock of a cache already open would keep the file from being opened again
+        analysisCache.reset();
+        analysisCache = make_unique<AnalysisCache>(path, capacity);
+        if(!analysisCache->isOpen()){
+            analysisCache.reset();
+            return false;
+        }
+        return true;
+    }
+
+
+    /**
+     * Fingerprints the parameters that shape the result of a search (see AnalysisCache::matchFingerprint).
+     * The files of the GP models count, so retrained models do not reuse older results.
+     * 
+     * @return uint64_t Fingerprint
+     */
+    uint64_t searchFingerprint(){
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        auto mix = [&hash](const void* data, size_t size){
+            for(size_t i = 0; i < size; i++){
+                hash = (hash ^ ((const uint8_t*) data)[i]) * 0x100000001b3ULL;
+            }
+        };
+
+        float parameters[] = {(float) simulationsPerRollout, mctsParameter, (float) rolloutPolicyParameter, (float) rolloutPolicyFunction,
+                              (float) useModelForUCT, (float) rolloutCutoff, cutoffMargin, cutoffScale, cutoffWallValue,
+                              (float) tacticalDepth, (float) tacticalRollouts, (float) lockstepRollouts, (float) useTranspositions,
+                              (float) foldMirrors, (float) progressiveWidening, wideningFactor, wideningExponent,
+                              (float) rave, raveEquivalence, (float) asyncPriors, (float) nodeBudget,
+                              (float) priorBatchSize, (float) eagerChildPriors, (float) decisiveRollouts};
+        mix(parameters, sizeof(parameters));
+
+        // Version 2: decisive rollouts, and generateMoveOnShortestPath no longer reads before a path of one cell
+        int version = SEARCH_VERSION;
+        mix(&version, sizeof(version));
+
+        // Merged visits of several trees differ from those of one, a single process keeps the fingerprints of older files
+        if(rootWorkers > 1){
+            mix(&rootWorkers, sizeof(rootWorkers));
+        }
+
+        bool usesModels = useModelForUCT || rolloutPolicyFunction == 3;
+        error_code error;
+        if(usesModels && modelDirectory != "" && filesystem::is_directory(modelDirectory, error)){
+            vector<string> models;
+            for(auto& model : filesystem::directory_iterator(modelDirectory, error)){
+                auto modified = model.last_write_time(error).time_since_epoch().count();
+                models.push_back(model.path().filename().string() + ":" + to_string(model.file_size(error)) + ":" + to_string(modified));
+            }
+            sort(models.begin(), models.end());
+            for(string& model : models){
+                mix(model.data(), model.size());
+            }
+        }
+        return hash;
+    }
+
+
+    /**
+     * Runs MCTS and returns the best move according to visit count.
+     * This is used when predicting agent's next move.
+     * 
+     * @param state Current board state
+     * @param whiteTurn Whether it's white's turn
+     * @param searchStats Optional output, telemetry of the search (only collected with MCTS_TELEMETRY)
+     * @return uint8_t Best move determined by MCTS
+     */
+    uint8_t predictBestMove(Board state, bool whiteTurn, SearchStats* searchStats = nullptr){
+        // The opponent's move has arrived, the tree is needed by this thread now
+        stopPondering();
+
+        // Speed up endgame decisions
+        bool playerHasNoWall = (whiteTurn && !state.whiteWalls) || (!whiteTurn && !state.blackWalls);
+        if(playerHasNoWall){
+            if(searchStats){
+                *searchStats = SearchStats();
+            }
+            return state.generateMoveOnShortestPath(whiteTurn);
+        }
+
+        // The kept tree has to follow the game when pondering, and a time budget has no rollout count to compare
+        bool useCache = analysisCache && !ponder && timeBudget <= 0;
+        if(useCache){
+            const AnalysisEntry* entry = analysisCache->lookup(state, whiteTurn, searchFingerprint(), false);
+            if(entry && entry->rollouts >= rollouts){
+                if(searchStats){
+                    *searchStats = SearchStats();
+                }
+                return entry->bestMove;
+            }
+        }
+
+        // The trees of the workers are not kept, so neither reuseTree nor ponder apply
+        if(rootWorkers > 1){
+            int visits[256] = {0};
+            uint8_t bestMove;
+            if(searchRootParallel(state, whiteTurn, earlyStop, visits, bestMove)){
+                if(useCache){
+                    storeAnalysis(nullptr, state, whiteTurn, rollouts, !rolloutsSaved, bestMove, visits);
+                }
+                if(searchStats){
+                    *searchStats = stats;
+                }
+                return bestMove;
+            }
+        }
+
+        if(reuseTree){
+            Node* root = reuseSearchTree(state, whiteTurn);
+            search(root, state, earlyStop);
+            uint8_t bestMove = mostVisitedMove(root);
+            if(useCache){
+                storeAnalysis(root, state, whiteTurn, rollouts, !rolloutsSaved, bestMove, 0);
+            }
+
+            // Pondering overwrites stats
+            if(searchStats){
+                *searchStats = stats;
+            }
+
+            if(ponder){
+                Board nextState = state;
+                nextState.executeMove(bestMove, whiteTurn);
+                startPondering(nextState, !whiteTurn);
+            }
+            return bestMove;
+        }
+
+        Node* mctsTree = buildTree(state, whiteTurn, earlyStop);
+        uint8_t bestMove = mostVisitedMove(mctsTree);
+        if(useCache){
+            storeAnalysis(mctsTree, state, whiteTurn, rollouts, !rolloutsSaved, bestMove, 0);
+        }
+        if(searchStats){
+            *searchStats = stats;
+        }
+
+        delete(mctsTree);
+        transpositions.clear();
+        return bestMove;
+    }
+
+
+    /**
+     * Re-roots the kept tree at the given state and keeps expanding it in a background thread,
+     * until stopPondering is called or ponderRollouts is reached.
+     * 
+     * @param state Board state after the agent's move
+     * @param whiteTurn Whether it's white's turn in @param state
+     * @return void
+     */
+    void startPondering(Board& state, bool whiteTurn){
+        if(state.getWinner()){
+            return;
+        }
+
+        Node* root = reuseSearchTree(state, whiteTurn);
+        ponderStop->store(false);
+        ponderThread = thread([this, root, state](){
+            growTree(root, state, ponderRollouts, ponderStop.get());
+        });
+    }
+
+
+    /**
+     * Stops the background search (if any) and waits for it to finish.
+     * 
+     * @return void
+     */
+    void stopPondering(){
+        if(!ponderThread.joinable()){
+            return;
+        }
+
+        ponderStop->store(true);
+        ponderThread.join();
+    }
+
+
+    /**
+     * Returns the root of the kept search tree for the given state.
+     * If the state was reached from the previous root by at most 2 moves (own and opponent's),
+     * the tree is re-rooted at the matching node and only the discarded siblings are freed.
+     * Otherwise the old tree is dropped and a fresh root is created.
+     * 
+     * @param state Current board state
+     * @param whiteTurn Whether it's white's turn
+     * @return Node* Root of the search tree for @param state
+     */
+    Node* reuseSearchTree(Board& state, bool whiteTurn){
+        Node* found = nullptr;
+        Node** slot = nullptr;
+        int plies = 0;
+        if(searchTree){
+            found = findSubtree(searchTree.get(), &searchTreeBoard, state, whiteTurn, 2, slot, plies);
+        }
+
+        // The root must be registered in the orientation of the board, a node shared with the mirrored position is not reused
+        if(found && useTranspositions && found->hash != state.zobristHash(whiteTurn)){
+            found = nullptr;
+        }
+
+        if(!found){
+            searchTree.reset(newRoot(state, whiteTurn));
+            searchTreeBoard = state;
+            return searchTree.get();
+        }
+
+        if(found != searchTree.get()){
+            // Detach the subtree, so deleting the old root only frees the discarded siblings.
+            // The kept tree takes over the reference of the parent.
+            *slot = nullptr;
+            searchTree.reset(found);
+            searchTreeBoard = state;
+        }
+
+        if(useTranspositions){
+            transpositions.clear();
+            rebuildTranspositions(found);
+        }
+
+        unordered_set<Node*> counted;
+        treeNodes = countNodes(found, counted);
+
+        return found;
+    }
+
+
+    /**
+     * Counts the nodes of a tree (shared nodes once).
+     * 
+     * @param node Current node in the MCTS tree
+     * @param counted Nodes already counted
+     * @return long long Number of nodes not counted before in the subtree of @param node
+     */
+    long long countNodes(Node* node, unordered_set<Node*>& counted){
+        if(!counted.insert(node).second){
+            return 0;
+        }
+
+        long long count = 1;
+        if(!node->children){
+            return count;
+        }
+
+        for(int move = 0; move < 256; move++){
+            Node* child = node->children[move];
+            if(child){
+                count += countNodes(child, counted);
+            }
+        }
+        return count;
+    }
+
+
+    /**
+     * Shrinks the tree below pruneTarget * nodeBudget nodes.
+     * Expanded nodes whose children are all leaves are collapsed, least visited first,
+     * each pass exposes the next layer of such nodes. The root is never collapsed.
+     * 
+     * @param root Root of the MCTS tree
+     * @return void
+     */
+    void pruneTree(Node* root){
+        long long target = (long long) (nodeBudget * pruneTarget);
+        vector<Node*> frontier;
+        unordered_set<Node*> visited;
+
+        while(treeNodes > target){
+            frontier.clear();
+            visited.clear();
+            collectFrontier(root, root, frontier, visited);
+            if(frontier.empty()){
+                break;
+            }
+
+            sort(frontier.begin(), frontier.end(), [](Node* a, Node* b){
+                return a->whiteWins + a->blackWins < b->whiteWins + b->blackWins;
+            });
+
+            for(Node* node : frontier){
+                if(treeNodes <= target){
+                    break;
+                }
+                treeNodes -= node->collapse(transpositions);
+            }
+        }
+    }
+
+
+    /**
+     * Collects the expanded nodes (other than the root) whose children are all leaves.
+     * 
+     * @param node Current node in the MCTS tree
+     * @param root Root of the MCTS tree
+     * @param frontier Output, the nodes found
+     * @param visited Nodes already visited
+     * @return void
+     */
+    void collectFrontier(Node* node, Node* root, vector<Node*>& frontier, unordered_set<Node*>& visited){
+        if(!node->expanded || !visited.insert(node).second){
+            return;
+        }
+
+        bool leafChildren = true;
+        for(int move = 0; move < 256; move++){
+            Node* child = node->children[move];
+            if(child && child->expanded){
+                leafChildren = false;
+                collectFrontier(child, root, frontier, visited);
+            }
+        }
+
+        if(leafChildren && node != root){
+            frontier.push_back(node);
+        }
+    }
+
+
+    /**
+     * Searches the expanded part of the tree for the node representing the given state.
+     * 
+     * @param node Current node in the MCTS tree
+     * @param board Board at @param node (restored before returning)
+     * @param state Board state searched for
+     * @param whiteTurn Whether it's white's turn in @param state
+     * @param depth Maximum number of moves between @param node and @param state
+     * @param slot Outputs the child pointer of the parent pointing to the found node
+     * @param plies Outputs the number of moves between @param node and the found node
+     * @return Node* Node representing @param state, nullptr if not found
+     */
+    Node* findSubtree(Node* node, Board* board, Board& state, bool whiteTurn, int depth, Node**& slot, int& plies){
+        if(node->player == whiteTurn && *board == state){
+            return node;
+        }
+
+        if(depth == 0 || !node->expanded){
+            return nullptr;
+        }
+
+        // A node shared with the mirrored position indexes its children in its own orientation
+        bool mirrored = useTranspositions && node->hash != board->zobristHash(node->player);
+
+        for(int move = 0; move < 256; move++){
+            Node* child = node->children[move];
+            if(!child){
+                continue;
+            }
+
+            uint8_t boardMove = mirrored ? Board::mirrorMove(move) : move;
+            board->executeMove(boardMove, node->player);
+            Node* found = findSubtree(child, board, state, whiteTurn, depth - 1, slot, plies);
+            board->undoMove(boardMove, node->player);
+
+            if(found){
+                if(found == child){
+                    slot = &node->children[move];
+                }
+                plies++;
+                return found;
+            }
+        }
+
+        return nullptr;
+    }
+
+
+    /**
+     * Creates a new root (and clears the transposition table for the new tree).
+     * 
+     * @param state Board state at the root
+     * @param whiteTurn Whether it's white's turn
+     * @return Node* new root
+     */
+    Node* newRoot(Board& state, bool whiteTurn){
+        Node* root = new Node(whiteTurn, 0);
+        treeNodes = 1;
+
+        transpositions.clear();
+        transpositions.foldMirrors = foldMirrors;
+
+        if(useTranspositions){
+            PositionHash position = {state.zobristHash(whiteTurn), state.zobristHash(whiteTurn, true), 0};
+            root->hash = position.hash;
+            root->key = transpositions.key(position);
+            transpositions.insert(root->key, root);
+        }
+
+        return root;
+    }
+
+
+    /**
+     * Refills the transposition table with the nodes of a (re-rooted) tree.
+     * 
+     * @param node Current node in the MCTS tree
+     * @return void
+     */
+    void rebuildTranspositions(Node* node){
+        transpositions.insert(node->key, node);
+
+        if(!node->children){
+            return;
+        }
+
+        for(int move = 0; move < 256; move++){
+            Node* child = node->children[move];
+            if(child && child->key && !transpositions.find(child->key)){
+                rebuildTranspositions(child);
+            }
+        }
+    }
+
+
+    /**
+     * Runs MCTS and fills a distribution array with visit counts for all moves.
+     * This is used for data generation and data relabelling.
+     * 
+     * @param state Current board state
+     * @param whiteTurn Whether it's white's turn
+     * @param distribution Array to fill with visit counts
+     * @return void
+     */
+    void predictDistribution(Board state, bool whiteTurn, int* distribution){
+        // A ponder thread left by predictBestMove would grow the kept tree next to this search
+        stopPondering();
+
+        bool useCache = analysisCache && timeBudget <= 0;
+        if(useCache){
+            const AnalysisEntry* entry = analysisCache->lookup(state, whiteTurn, searchFingerprint(), true);
+            if(entry && entry->rollouts >= rollouts){
+                copy(entry->visits, entry->visits + 256, distribution);
+                return;
+            }
+        }
+
+        // A result searched with fewer rollouts is searched again, its tree is gone and a second tree would not add up to one search
+        Node* mctsTree = nullptr;
+        uint8_t bestMove = 0;
+        if(rootWorkers <= 1 || !searchRootParallel(state, whiteTurn, false, distribution, bestMove)){
+            mctsTree = buildTree(state, whiteTurn);
+            nodeVisits(mctsTree, distribution);
+            bestMove = mostVisitedMove(mctsTree);
+        }
+
+        if(useCache){
+            storeAnalysis(mctsTree, state, whiteTurn, rollouts, true, bestMove, distribution);
+        }
+        delete(mctsTree);
+        transpositions.clear();
+    }
+
+
+    /**
+     * Searches the position in rootWorkers forked processes and merges the visits at their roots (root parallelism).
+     * Every worker builds its own tree with a different seed and an equal share of the rollouts (or the whole time budget),
+     * and writes its result into memory shared with this process. A worker that crashes only loses its share.
+     * A win proven by any worker decides the move, and moves proven lost are only played when every move loses.
+     * 
+     * @param state Current board state
+     * @param whiteTurn Whether it's white's turn
+     * @param stopWhenDecided Whether the workers may end their search once their most visited move can no longer change
+     * @param visits Output array with 256 entries, the summed visits of the workers
+     * @param bestMove Output, the move chosen from the merged results
+     * @return bool Whether any worker finished, the caller has to search by itself otherwise
+     */
+    bool searchRootParallel(Board& state, bool whiteTurn, bool stopWhenDecided, int* visits, uint8_t& bestMove){
+        size_t size = rootWorkers * sizeof(RootWorkerSlot);
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(memory == MAP_FAILED){
+            return false;
+        }
+        RootWorkerSlot* slots = (RootWorkerSlot*) memory;
+        TELEMETRY(auto start = chrono::steady_clock::now();)
+
+        // Seeds are drawn before forking, so a seeded search stays reproducible
+        vector<pid_t> workers;
+        for(int worker = 0; worker < rootWorkers; worker++){
+            uint64_t seed = random.next() | 1;
+            int share = rollouts / rootWorkers + (worker < rollouts % rootWorkers);
+            pid_t pid = fork();
+            if(pid < 0){
+                break;
+            }
+            if(pid > 0){
+                workers.push_back(pid);
+                continue;
+            }
+
+            // Only the forking thread lives on in the worker, the evaluator thread of asyncPriors has to be started anew
+            priorEvaluator.release();
+            random.seed(seed);
+            rollouts = share;
+            Node* root = buildTree(state, whiteTurn, stopWhenDecided);
+
+            RootWorkerSlot& slot = slots[worker];
+            nodeVisits(root, slot.visits);
+            for(int move = 0; move < 256; move++){
+                slot.provenWinners[move] = root->children[move] ? root->children[move]->provenWinner : 0;
+            }
+            slot.bestMove = mostVisitedMove(root);
+            slot.rolloutsSaved = rolloutsSaved;
+            slot.expectedRollouts = expectedRollouts;
+            slot.stats = stats;
+            slot.finished = true;
+            // Skips the destructors and atexit handlers of the coordinator's state
+            _exit(0);
+        }
+
+        TELEMETRY(SearchStats merged;)
+        int finished = 0;
+        int saved = 0;
+        int expected = 0;
+        char provenWinners[256] = {0};
+        char mover = whiteTurn ? 'w' : 'b';
+        char opponent = whiteTurn ? 'b' : 'w';
+        uint8_t provenWin = 0;
+
+        for(size_t worker = 0; worker < workers.size(); worker++){
+            int status = 0;
+            while(waitpid(workers[worker], &status, 0) < 0 && errno == EINTR);
+            RootWorkerSlot& slot = slots[worker];
+            if(!WIFEXITED(status) || WEXITSTATUS(status) || !slot.finished){
+                continue;
+            }
+
+            finished++;
+            saved += slot.rolloutsSaved;
+            expected = max(expected, slot.expectedRollouts);
+            for(int move = 0; move < 256; move++){
+                visits[move] += slot.visits[move];
+                if(slot.provenWinners[move]){
+                    provenWinners[move] = slot.provenWinners[move];
+                }
+            }
+            if(slot.provenWinners[slot.bestMove] == mover){
+                provenWin = slot.bestMove;
+            }
+
+            TELEMETRY(merged.add(slot.stats);)
+        }
+        munmap(memory, size);
+
+        if(!finished){
+            return false;
+        }
+
+        // Same choice as mostVisitedMove, over the merged visits
+        bestMove = provenWin;
+        if(!provenWin){
+            int bestValue = INT_MIN;
+            for(int move = 0; move < 256; move++){
+                if(!visits[move] && !provenWinners[move]){
+                    continue;
+                }
+
+                int value = visits[move];
+                if(provenWinners[move] == opponent){
+                    value -= INT_MAX / 2;
+                }
+                if(value > bestValue){
+                    bestValue = value;
+                    bestMove = move;
+                }
+            }
+        }
+
+        rolloutsSaved = saved;
+        expectedRollouts = max(expected, 1);
+        TELEMETRY(
+            stats = merged;
+            stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            stats.rolloutsPerSecond = stats.seconds > 0 ? stats.rollouts / stats.seconds : 0;
+        )
+        return true;
+    }
+
+
+    /**
+     * Stores the result of a search in the analysis cache.
+     * 
+     * @param root Root of the searched tree
+     * @param state Board state at @param root
+     * @param whiteTurn Whether it's white's turn
+     * @param rolloutBudget Rollout budget the result stands for
+     * @param complete Whether the whole budget was searched
+     * @param bestMove Move chosen by the search
+     * @param visits Visits of the moves at the root, nullptr: the visits of @param root
+     * @return void
+     */
+    void storeAnalysis(Node* root, Board& state, bool whiteTurn, int rolloutBudget, bool complete, uint8_t bestMove, const int* visits){
+        int rootVisits[256] = {0};
+        if(!visits){
+            nodeVisits(root, rootVisits);
+            visits = rootVisits;
+        }
+        analysisCache->store(state, whiteTurn, searchFingerprint(), rolloutBudget, complete, bestMove, visits);
+    }
+
+
+    /**
+     * Builds the MCTS tree from the given state.
+     * 
+     * @param state Initial board state
+     * @param whiteTurn Whether it's white's turn
+     * @param stopWhenDecided Whether the search may end once the most visited move can no longer change
+     * @return Node* Root of the built MCTS tree
+     */
+    Node* buildTree(Board state, bool whiteTurn, bool stopWhenDecided = false){
+        Node *root = newRoot(state, whiteTurn);
+        search(root, state, stopWhenDecided);
+        return root;
+    }
+
+
+    /**
+     * Runs a search on the tree, either for a fixed number of rollouts or until timeBudget runs out.
+     * In time budgeted search the prior weights of the next search are derived from the rollouts completed.
+     * 
+     * @param root Root of the MCTS tree
+     * @param state Board state at @param root
+     * @param stopWhenDecided Whether the search may end once the most visited move can no longer change
+     * @return int Number of rollouts completed
+     */
+    int search(Node* root, Board& state, bool stopWhenDecided = false){
+        if(timeBudget <= 0){
+            expectedRollouts = rollouts;
+            return growTree(root, state, rollouts, nullptr, 0, stopWhenDecided);
+        }
+
+        int rolloutsCompleted = growTree(root, state, INT_MAX, nullptr, timeBudget, stopWhenDecided);
+        expectedRollouts = max(rolloutsCompleted + rolloutsSaved, 1);
+        return rolloutsCompleted;
+    }
+
+
+    /**
+     * Runs the rollouts on an existing tree (new or reused).
+     * 
+     * @param root Root of the MCTS tree
+     * @param state Board state at @param root
+     * @param rolloutBudget Number of rollouts to run
+     * @param stop Optional flag, the search returns early once it is set
+     * @param timeLimit Optional time limit in milliseconds (0: no limit)
+     * @param stopWhenDecided Whether to return once the most visited child of the root can no longer change
+     * @return int Number of rollouts completed
+     */
+    int growTree(Node* root, Board state, int rolloutBudget, atomic<bool>* stop = nullptr, int timeLimit = 0, bool stopWhenDecided = false){
+        rootPosition = {state.zobristHash(root->player), state.zobristHash(root->player, true), root->ply};
+        auto start = chrono::steady_clock::now();
+        auto deadline = start + chrono::milliseconds(timeLimit);
+        rolloutsSaved = 0;
+        stats = SearchStats();
+        TELEMETRY(long long nodesAllocatedBefore = NODES_ALLOCATED;)
+
+        // Lockstep rollouts fill the lanes of a batch with several leaves
+        int batchSize = priorBatchSize;
+        if(usesLockstep()){
+            batchSize = max(batchSize, ROLLOUT_LANES / simulationsPerRollout);
+        }
+
+        int rolloutsCompleted = 0;
+        int nextTimeCheck = 0;
+        int nextDecisionCheck = earlyStopInterval;
+        while(rolloutBudget > rolloutsCompleted){
+            if(stop && stop->load(memory_order_relaxed)){
+                break;
+            }
+
+            // Reading the clock is cheap, but not free, so only check it every few rollouts
+            if(timeLimit && rolloutsCompleted >= nextTimeCheck){
+                if(chrono::steady_clock::now() >= deadline){
+                    break;
+                }
+                nextTimeCheck = rolloutsCompleted + timeCheckInterval;
+            }
+
+            if(stopWhenDecided && rolloutsCompleted >= nextDecisionCheck){
+                nextDecisionCheck = rolloutsCompleted + earlyStopInterval;
+
+                long long remaining = rolloutBudget - rolloutsCompleted;
+                if(timeLimit){
+                    // Rollouts that would fit into the remaining time at the rate seen so far
+                    auto now = chrono::steady_clock::now();
+                    double elapsed = chrono::duration<double>(now - start).count();
+                    double left = chrono::duration<double>(deadline - now).count();
+                    remaining = min(remaining, (long long) ceil(rolloutsCompleted * left / max(elapsed, 1e-6)));
+                }
+
+                if(isDecided(root, remaining)){
+                    rolloutsSaved = remaining;
+                    break;
+                }
+            }
+
+            if(priorEvaluator){
+                applyPriors(false);
+            }
+
+            if(nodeBudget && treeNodes > nodeBudget){
+                // Collapsed nodes must not be waiting for a prior
+                if(priorEvaluator){
+                    applyPriors(true);
+                }
+                pruneTree(root);
+            }
+
+            rolloutsCompleted += playBatch(root, state, min(batchSize, rolloutBudget - rolloutsCompleted));
+        }
+
+        // The nodes waiting for priors may be freed once the search returns
+        if(priorEvaluator){
+            applyPriors(true);
+        }
+
+        TELEMETRY(
+            stats.rollouts = rolloutsCompleted;
+            stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            stats.rolloutsPerSecond = stats.seconds > 0 ? rolloutsCompleted / stats.seconds : 0;
+            stats.nodesAllocated = NODES_ALLOCATED - nodesAllocatedBefore;
+        )
+
+        return rolloutsCompleted;
+    }
+
+
+    /**
+     * Checks whether the most visited child of the root stays the most visited one,
+     * even if every remaining rollout went to the runner-up (or the root is proven).
+     * 
+     * @param root Root of the MCTS tree
+     * @param remainingRollouts Number of rollouts left in the budget
+     * @return bool Whether the decision can no longer change
+     */
+    bool isDecided(Node* root, long long remainingRollouts){
+        if(root->provenWinner){
+            return true;
+        }
+
+        if(!root->expanded){
+            return false;
+        }
+
+        int best = 0;
+        int runnerUp = 0;
+        for(int move = 0; move < 256; move++){
+            Node* child = root->children[move];
+            if(!child){
+                continue;
+            }
+
+            int visits = child->whiteWins + child->blackWins;
+            if(visits > best){
+                runnerUp = best;
+                best = visits;
+            } else if(visits > runnerUp){
+                runnerUp = visits;
+            }
+        }
+
+        return best - runnerUp > remainingRollouts * simulationsPerRollout;
+    }
+
+
+    /**
+     * Applies the priors evaluated by priorEvaluator to their nodes and releases the nodes.
+     * 
+     * @param wait Whether to wait for the outstanding requests as well
+     * @return void
+     */
+    void applyPriors(bool wait){
+        if(wait){
+            priorEvaluator->collectAll(priorResults);
+        } else {
+            priorEvaluator->collect(priorResults);
+        }
+
+        for(PriorResult& result : priorResults){
+            Node* node = result.request.node;
+            node->applyPrior(result.prior, result.request.heuristicsWeight, result.request.mirrored);
+            if(--node->references == 0){
+                delete node;
+            }
+        }
+        priorResults.clear();
+    }
+
+
+    /**
+     * Runs rollouts until a selected leaf can be expanded without a GP prior, or batchSize leaves wait for one.
+     * Leaves needing a prior are held back with a virtual loss along their path, so the next selections spread
+     * over other leaves, then their priors are evaluated together (see evaluatePendingLeaves).
+     * With lockstepRollouts, leaves are held back the same way until their rollouts fill rolloutBatch (see playLockstep).
+     * Without GP guided expansion (or with asyncPriors) and lockstep rollouts this is a single ordinary rollout.
+     * 
+     * @param root Root of the MCTS tree
+     * @param state Board state at @param root
+     * @param batchSize Maximum number of rollouts in the batch
+     * @return int Number of rollouts completed
+     */
+    int playBatch(Node* root, Board& state, int batchSize){
+        // The entries are reused, so the paths they hold keep their capacity
+        pendingCount = 0;
+        lockstepCount = 0;
+        rolloutBatch.clear();
+        bool lockstep = usesLockstep();
+        int rolloutsCompleted = 0;
+
+        // The selection plays on state in place and is rewound afterwards
+        Board& board = state;
+        while(true){
+            PositionHash position;
+            int depth;
+            Node* leaf = selectLeaf(root, &board, position, depth);
+
+            // A leaf proven by the alpha-beta is not expanded, the root is always expanded to choose a move
+            if(tacticalDepth && depth && !board.getWinner() && !leaf->provenWinner){
+                leaf->provenWinner = proveTactics(&board, leaf->player);
+            }
+
+            bool resolved = board.getWinner() || leaf->provenWinner;
+            Quoridor_GP* model = resolved ? nullptr : leafModel(leaf, &board, depth);
+            bool precomputed = model && findChildPrior(leaf, &board, depth, scratch.prior);
+            if(model && !precomputed && priorBatchSize > 1 && batchSize > 1 && !asyncPriors){
+                // The leaf is already waiting for its prior, the selection is not changed by virtual loss anymore
+                bool pending = any_of(pendingLeaves.begin(), pendingLeaves.begin() + pendingCount, [leaf](PendingLeaf& p){ return p.node == leaf; });
+                if(pending){
+                    rewind(&board);
+                    break;
+                }
+
+                addVirtualLoss(searchPath, simulationsPerRollout);
+                if(pendingCount == (int) pendingLeaves.size()){
+                    pendingLeaves.emplace_back();
+                }
+                PendingLeaf& pendingLeaf = pendingLeaves[pendingCount++];
+                pendingLeaf.node = leaf;
+                pendingLeaf.board = board;
+                pendingLeaf.position = position;
+                pendingLeaf.depth = depth;
+                pendingLeaf.model = model;
+                pendingLeaf.path.assign(searchPath.begin(), searchPath.end());
+                pendingLeaf.moves.assign(searchMoves.begin(), searchMoves.end());
+                pendingLeaf.mirrored.assign(searchMirrored.begin(), searchMirrored.end());
+                rewind(&board);
+                if(pendingCount + lockstepCount < batchSize){
+                    continue;
+                }
+                break;
+            }
+
+            // When a board has a winner, it must be a leaf
+            if(!resolved){
+                leaf = expandLeaf(leaf, &board, position, depth, model, precomputed ? &scratch.prior : nullptr);
+            }
+
+            if(lockstep && !board.getWinner() && !leaf->provenWinner){
+                queueLockstep(leaf, board);
+                rewind(&board);
+                bool lanesLeft = rolloutBatch.lanes + simulationsPerRollout <= ROLLOUT_LANES;
+                if(lanesLeft && pendingCount + lockstepCount < batchSize){
+                    continue;
+                }
+                break;
+            }
+
+            simulate(leaf, board);
+            rewind(&board);
+            rolloutsCompleted++;
+            break;
+        }
+
+        evaluatePendingLeaves();
+        playLockstep();
+        return rolloutsCompleted + pendingCount + lockstepCount;
+    }
 
 
     /**
-     * Expands the current node by generating its child nodes.
-     * Optionally calculates heuristics for children and weights them.
-     *
-     * @param board Pointer to the current board state
-     * @param heuristicsWeight Multiplier for heuristic value
-     * @param model model used for prediction
+     * Holds a selected leaf back with a virtual loss along its path and adds its simulations to rolloutBatch.
+     * 
+     * @param leaf Leaf node of the selection (no winner, not proven)
+     * @param board Board at @param leaf
      * @return void
      */
-    void expandNode(Board* board, int heuristicsWeight = 100, Quoridor_GP* model = nullptr){
-        uint8_t possibleMoves[256];
-        size_t moveCount = 0;
-        board->generatePossibleMoves(this->player, possibleMoves, moveCount);
+    void queueLockstep(Node* leaf, Board& board){
+        TELEMETRY(
+            int depth = searchPath.size() - 1;
+            stats.maxDepth = max(stats.maxDepth, depth);
+            stats.depthSum += depth;
+        )
+
+        addVirtualLoss(searchPath, simulationsPerRollout);
+        int lane = rolloutBatch.lanes;
+        for(int i = 0; i < simulationsPerRollout; i++){
+            rolloutBatch.add(board, leaf->player);
+        }
+        if(lockstepCount == (int) lockstepLeaves.size()){
+            lockstepLeaves.emplace_back();
+        }
+        LockstepLeaf& lockstepLeaf = lockstepLeaves[lockstepCount++];
+        lockstepLeaf.node = leaf;
+        lockstepLeaf.path.assign(searchPath.begin(), searchPath.end());
+        lockstepLeaf.lane = lane;
+    }
 
-        // Do not want to preallocate, as that would result in a ~100x memory usage.
-        this->children = (Node**) malloc(256 * sizeof(Node*));
 
-        // Init to nullptr, so we avoid those nasty-nasty segfaults.
-        for(int i = 0; i < 256; i++){
-            this->children[i] = nullptr;
+    /**
+     * Whether rollouts are played in lockstep (lockstepRollouts). The batch only plays its own version of
+     * rolloutPolicyFunction 2 without decisive moves, and does not record the moves RAVE needs, other settings keep scalar rollouts.
+     * 
+     * @return bool Whether rollouts go to rolloutBatch
+     */
+    bool usesLockstep(){
+        return lockstepRollouts && !rave && rolloutPolicyFunction == 2 && !decisiveRollouts && simulationsPerRollout <= ROLLOUT_LANES;
+    }
+
+
+    /**
+     * Plays the rollouts of rolloutBatch in lockstep, then backpropagates their results along the paths of lockstepLeaves.
+     * The policy follows rolloutPolicy_BestPawnMovement: the player to move tries to place a random wall next to
+     * the opponent's pawn with probability 1 / rolloutPolicyParameter (three draws of a free place), and otherwise
+     * steps along a shortest path. Each ply floods all lanes once for the pawn steps, and once more for the lanes
+     * placing a wall, to check that both pawns can still reach their goals.
+     * Rollouts end like in rollout (ROLLOUT_LENGTH, rolloutCutoff), the lead is checked every ply as flood gives it for free.
+     * 
+     * @return void
+     */
+    void playLockstep(){
+        if(!lockstepCount){
+            return;
         }
 
-        this->expanded = true;
+        RolloutBatch& batch = rolloutBatch;
+        bool active[ROLLOUT_LANES] = {false};
+        bool walling[ROLLOUT_LANES] = {false};
+        uint8_t walls[ROLLOUT_LANES];
+        uint8_t steps[2][ROLLOUT_LANES];
+        {
+            TELEMETRY(PhaseTimer timer(stats.rolloutSeconds); stats.simulations += batch.lanes;)
+            int activeLanes = batch.lanes;
+            fill(active, active + batch.lanes, true);
+
+            for(int plies = 0; activeLanes > 0; plies++){
+                batch.flood(active);
+
+                for(int lane = 0; lane < batch.lanes; lane++){
+                    if(!active[lane]){
+                        continue;
+                    }
+
+                    int whitePath = batch.distance[0][lane];
+                    int blackPath = batch.distance[1][lane];
+                    bool whiteWon;
+                    if(plies == ROLLOUT_LENGTH){
+                        // Like Board::whiteCloser, the player to move wins a tie
+                        whiteWon = whitePath < blackPath || (whitePath == blackPath && batch.player[lane]);
+                    } else if(!rolloutCutoff || !evaluateCutoff(whitePath, blackPath, batch.whiteWalls[lane], batch.blackWalls[lane], batch.player[lane], plies, whiteWon)){
+                        continue;
+                    }
+
+                    batch.winner[lane] = whiteWon ? 'w' : 'b';
+                    active[lane] = false;
+                    activeLanes--;
+                }
 
-        if (model) {
-            // Use GP to predict heuristic
-            VectorXd childrenHeuristic = model->predict(board->toInputVector(player));
-            for(int i = 0; i < moveCount; i++){
-                uint8_t child = possibleMoves[i];    
-                this->children[child] = new Node(this, !this->player, (float) childrenHeuristic(child) * heuristicsWeight);
+                int wallLanes = 0;
+                for(int lane = 0; lane < batch.lanes; lane++){
+                    walling[lane] = false;
+                    bool hasWall = batch.player[lane] ? batch.whiteWalls[lane] : batch.blackWalls[lane];
+                    if(!active[lane] || !hasWall || random.below(rolloutPolicyParameter) != 0){
+                        continue;
+                    }
+
+                    // Walls touching the opponent's cell, the first kind of Board::generateProbableWallPlacements
+                    uint8_t opponent = batch.player[lane] ? batch.blackPawn[lane] : batch.whitePawn[lane];
+                    for(int tries = 0; tries < 3; tries++){
+                        int i = (opponent >> 4) - (int) random.below(2);
+                        int j = (opponent & 0xf) - (int) random.below(2);
+                        if(i < 0 || i > 7 || j < 0 || j > 7){
+                            continue;
+                        }
+
+                        uint8_t wallPlacement = (random.below(2) << 6) | (i << 3) | j;
+                        if(!batch.takenWallPlaces[lane][wallPlacement]){
+                            batch.placeWall(lane, wallPlacement);
+                            walls[lane] = wallPlacement;
+                            walling[lane] = true;
+                            wallLanes++;
+                            break;
+                        }
+                    }
+                }
+
+                if(wallLanes){
+                    // The pawn steps found before the walls are kept for the lanes whose wall is rejected
+                    copy(&batch.steps[0][0], &batch.steps[0][0] + 2 * ROLLOUT_LANES, &steps[0][0]);
+                    batch.flood(walling);
+                    copy(&steps[0][0], &steps[0][0] + 2 * ROLLOUT_LANES, &batch.steps[0][0]);
+
+                    for(int lane = 0; lane < batch.lanes; lane++){
+                        if(!walling[lane]){
+                            continue;
+                        }
+
+                        if(batch.distance[0][lane] != PATH_BLOCKED && batch.distance[1][lane] != PATH_BLOCKED){
+                            batch.commitWall(lane, walls[lane]);
+                        } else {
+                            batch.removeWall(lane, walls[lane]);
+                            walling[lane] = false;
+                        }
+                    }
+                }
+
+                for(int lane = 0; lane < batch.lanes; lane++){
+                    if(!active[lane]){
+                        continue;
+                    }
+                    TELEMETRY(stats.rolloutPlies++;)
+
+                    if(!walling[lane]){
+                        batch.stepPawn(lane, random);
+                        if((batch.whitePawn[lane] >> 4) == 8 || (batch.blackPawn[lane] >> 4) == 0){
+                            batch.winner[lane] = batch.player[lane] ? 'w' : 'b';
+                            active[lane] = false;
+                            activeLanes--;
+                        }
+                    }
+                    batch.player[lane] = !batch.player[lane];
+                }
             }
+        }
+
+        for(int l = 0; l < lockstepCount; l++){
+            LockstepLeaf& leaf = lockstepLeaves[l];
+            int whiteWins = 0;
+            for(int i = 0; i < simulationsPerRollout; i++){
+                whiteWins += batch.winner[leaf.lane + i] == 'w';
+            }
+
+            addVirtualLoss(leaf.path, -simulationsPerRollout);
+            backpropagate(leaf.path, whiteWins, simulationsPerRollout - whiteWins);
+        }
+    }
+
+
+    /**
+     * Evaluates the priors of the pending leaves, one matrix product per model, then expands the leaves
+     * and runs their rollouts.
+     * 
+     * @return void
+     */
+    void evaluatePendingLeaves(){
+        vector<bool>& evaluated = scratch.evaluated;
+        vector<input_vector>& inputs = scratch.inputs;
+        vector<int>& batch = scratch.batch;
+        evaluated.assign(pendingCount, false);
+
+        for(int i = 0; i < pendingCount; i++){
+            if(evaluated[i]){
+                continue;
+            }
+
+            Quoridor_GP* model = pendingLeaves[i].model;
+            batch.clear();
+            for(int j = i; j < pendingCount; j++){
+                if(!evaluated[j] && pendingLeaves[j].model == model){
+                    batch.push_back(j);
+                    evaluated[j] = true;
+                }
+            }
+
+            // The input vectors are encoded in place, the entries keep their storage
+            if(inputs.size() < batch.size()){
+                inputs.resize(batch.size());
+            }
+            for(size_t b = 0; b < batch.size(); b++){
+                PendingLeaf& pendingLeaf = pendingLeaves[batch[b]];
+                pendingLeaf.board.toInputVector(pendingLeaf.node->player, inputs[b]);
+            }
+
+            {
+                TELEMETRY(PhaseTimer timer(stats.gpSeconds); stats.gpCalls++; stats.gpPositions += batch.size();)
+                model->predict_batch(inputs.data(), batch.size(), scratch.gp);
+            }
+            VectorXd& prior = scratch.prior;
+            for(size_t b = 0; b < batch.size(); b++){
+                PendingLeaf& pendingLeaf = pendingLeaves[batch[b]];
+                prior = scratch.gp.outputs.col(b);
+
+                addVirtualLoss(pendingLeaf.path, -simulationsPerRollout);
+                searchPath.swap(pendingLeaf.path);
+                searchMoves.swap(pendingLeaf.moves);
+                searchMirrored.swap(pendingLeaf.mirrored);
+                Node* leaf = expandLeaf(pendingLeaf.node, &pendingLeaf.board, pendingLeaf.position, pendingLeaf.depth, model, &prior);
+                simulate(leaf, pendingLeaf.board);
+            }
+        }
+    }
+
+
+    /**
+     * Counts simulations along a path as losses for the players choosing the nodes (or removes them).
+     * 
+     * @param path Nodes visited from the root to a leaf
+     * @param losses Number of losses to add (negative to remove them)
+     * @return void
+     */
+    void addVirtualLoss(vector<Node*>& path, int losses){
+        for(Node* node : path){
+            // A loss for the player choosing the node is a win for the player to move at the node
+            if(node->player){
+                node->addResults(losses, 0);
+            } else {
+                node->addResults(0, losses);
+            }
+        }
+    }
 
+
+    /**
+     * Runs the simulations from a leaf and backpropagates the results along searchPath.
+     * A terminal or proven leaf is not simulated, its result is backpropagated and its proof propagated instead.
+     * 
+     * @param leaf Leaf node of the selection
+     * @param board Board at @param leaf
+     * @return void
+     */
+    void simulate(Node* leaf, Board& board){
+        TELEMETRY(
+            int depth = searchPath.size() - 1;
+            stats.maxDepth = max(stats.maxDepth, depth);
+            stats.depthSum += depth;
+        )
+
+        char winner = leaf->provenWinner ? leaf->provenWinner : board.getWinner();
+        if(winner){
+            leaf->provenWinner = winner;
+            propagateProof(searchPath);
+            backpropagate(searchPath, winner == 'w' ? simulationsPerRollout : 0, winner == 'b' ? simulationsPerRollout : 0);
             return;
         }
 
-        for(int i = 0; i < moveCount; i++){
-            uint8_t child = possibleMoves[i];    
-            this->children[child] = new Node(this, !this->player, 0);
+        int whiteWins = 0;
+        for(int i = 0; i < simulationsPerRollout; i++){
+            TELEMETRY(PhaseTimer timer(stats.rolloutSeconds); stats.simulations++;)
+            if(!rave){
+                whiteWins += rollout(&board, leaf->player);
+                continue;
+            }
+
+            raveMoves.assign(searchMoves.begin(), searchMoves.end());
+            bool whiteWon = rollout(&board, leaf->player, &raveMoves);
+            updateAmaf(whiteWon);
+            whiteWins += whiteWon;
         }
+
+        backpropagate(searchPath, whiteWins, simulationsPerRollout - whiteWins);
     }
 
 
     /**
-     * Calculates the UCT value of the node based on MCTS and heuristic evaluation.
-     *
-     * @param player Perspective of the player (true = white, false = black)
-     * @param mctsParameter Exploration constant used in UCT formula
-     * @return float Value of the node
+     * Updates the AMAF statistics along searchPath with a simulation (moves in raveMoves).
+     * At every node, the child of each move its player made later in the simulation gets the result,
+     * repeated moves only count once.
+     * 
+     * @param whiteWon Whether white won the simulation
+     * @return void
      */
-    float getValue(bool player, float mctsParameter){
-        float n_node = (float)(this->whiteWins + this->blackWins);
+    void updateAmaf(bool whiteWon){
+        for(size_t i = 0; i < searchMoves.size(); i++){
+            Node* node = searchPath[i];
+            bool seen[256] = {false};
+
+            // The player at the node makes every second move from here on
+            for(size_t t = i; t < raveMoves.size(); t += 2){
+                uint8_t move = raveMoves[t];
+                if(seen[move]){
+                    continue;
+                }
+                seen[move] = true;
 
-        if (n_node == 0){
-            return -1;
+                Node* child = node->children[searchMirrored[i] ? Board::mirrorMove(move) : move];
+                if(!child){
+                    continue;
+                }
+
+                if(whiteWon){
+                    child->amafWhiteWins++;
+                } else {
+                    child->amafBlackWins++;
+                }
+            }
         }
+    }
 
-        float n_parent = (float)(parent ? this->parent->whiteWins + this->parent->blackWins : n_node);
 
-        float wins = (float)(player ? whiteWins : blackWins);
+    /**
+     * Undoes the moves of the last selection (searchMoves), taking the board back to the root position.
+     * 
+     * @param board Pointer to the board at the end of the selection (updated)
+     * @return void
+     */
+    void rewind(Board* board){
+        for(int i = searchMoves.size() - 1; i >= 0; i--){
+            board->undoMove(searchMoves[i], searchPath[i]->player);
+        }
+    }
+
+
+    /**
+     * Descends the tree by UCT until an unexpanded node, the path is stored in searchPath.
+     * 
+     * @param node Root of the MCTS tree
+     * @param board Pointer to the board at @param node (updated)
+     * @param position Outputs the hashes of the position of the leaf
+     * @param depth Outputs the depth of the leaf
+     * @return Node* Unexpanded (or terminal) node
+     */
+    Node* selectLeaf(Node* node, Board* board, PositionHash& position, int& depth){
+        TELEMETRY(PhaseTimer timer(stats.selectionSeconds);)
+        searchPath.clear();
+        searchPath.push_back(node);
+        searchMoves.clear();
+        searchMirrored.clear();
+        position = rootPosition;
+
+        // A proven node is not searched further, its result is known
+        depth = 0;
+        while(node->expanded && !node->provenWinner){
+            if(progressiveWidening){
+                widen(node, board, position);
+            }
+
+            uint8_t bestMove = bestUCT(node);
+
+            node = descend(node, board, bestMove, position);
+
+            depth++;
+        }
 
-        return (this->heuristicValue + wins) / n_node + mctsParameter * sqrt(log(n_parent) / n_node);
+        return node;
     }
 
 
     /**
-     * Node constructor
+     * Chooses the GP model guiding the expansion of a leaf.
      * 
-     * @param parent Pointer to the parent node
-     * @param player true: white's turn, false: black's turn
-     * @param heuristicValue Heuristic value assigned to this node
+     * @param node Leaf node
+     * @param board Pointer to the board at @param node
+     * @param depth Depth of @param node
+     * @return Quoridor_GP* Model to use, nullptr if the expansion is not guided by a model
      */
-    Node(Node* parent, bool player, float heuristicValue){
-        this->parent = parent;
-        this->player = player;
-        this->expanded = false;
-        this->whiteWins = 0;
-        this->blackWins = 0;
-        this->heuristicValue = heuristicValue;
+    Quoridor_GP* leafModel(Node* node, Board* board, int depth){
+        if(!useModelForUCT || depth > 1){
+            return nullptr;
+        }
+
+        int wallsOnBoard = 20 - board->blackWalls - board->whiteWalls;
+        if(depth == 0){
+            return node->player ? whiteModels + wallsOnBoard : blackModels + wallsOnBoard;
+        }
+        return node->player ? smallWhiteModels + wallsOnBoard : smallBlackModels + wallsOnBoard;
     }
 
 
     /**
-     * Node destructor
-     * Recursively deletes all child nodes and frees memory
+     * Expands a leaf and descends to the child with the best UCT value.
+     * Without a precomputed prior, the model is evaluated here, or with asyncPriors the leaf is expanded
+     * with a placeholder prior and the model's prediction is applied once priorEvaluator delivers it.
+     * 
+     * @param node Leaf node (not terminal)
+     * @param board Pointer to the board at @param node (updated)
+     * @param position Hashes of the position on @param board
+     * @param depth Depth of @param node
+     * @param model Model guiding the expansion (nullptr: no model)
+     * @param prior Move distribution already predicted by @param model for @param board
+     * @return Node* Child to simulate from
      */
-    ~Node() {
-        if(!this->children){
-            return;
+    Node* expandLeaf(Node* node, Board* board, PositionHash position, int depth, Quoridor_GP* model, const VectorXd* prior = nullptr){
+        int simulations = expectedRollouts * simulationsPerRollout;
+        int heuristicsWeight = depth ? (simulations >> 10) : (simulations >> 6);
+        bool mirrored = useTranspositions && node->hash != position.hash;
+        if(eagerChildPriors && model && !depth){
+            predictChildPriors(node, board);
         }
 
-        for(int i = 0; i < 256; i++){
-            if(this->children[i]){
-                delete this->children[i];
+        if(model && !prior){
+            if(asyncPriors){
+                if(!priorEvaluator){
+                    priorEvaluator = make_unique<PriorEvaluator>();
+                }
+                node->references++;
+                priorEvaluator->request({node, model, board->toInputVector(node->player), heuristicsWeight, mirrored});
+                TELEMETRY(stats.gpCalls++; stats.gpPositions++;)
+            } else {
+                TELEMETRY(PhaseTimer timer(stats.gpSeconds); stats.gpCalls++; stats.gpPositions++;)
+                board->toInputVector(node->player, scratch.input);
+                prior = &model->predict(scratch.input, scratch.gp);
             }
         }
 
-        // Free the array of child pointers, 
-        // Yes, it has been pointed out, that I should've used new and delete instead 
-        // Yes, I tried to use a malloc-delete combination, compiler did not catch it, but it obviously did not work
-        free(this->children); 
+        {
+            TELEMETRY(PhaseTimer timer(stats.expansionSeconds);)
+            if(progressiveWidening){
+                node->expandNodeLazily(board, heuristicsWeight, prior, mirrored);
+                widen(node, board, position);
+            } else {
+                node->expandNode(board, heuristicsWeight, prior, mirrored);
+                treeNodes += node->childCount;
+            }
+        }
+        uint8_t bestMove = bestUCT(node);
+
+        node = descend(node, board, bestMove, position);
+        return node;
     }
-};
 
 
-/**
- * MCTS agent
- */
-class MCTS
-{
-    public: 
+    /**
+     * Predicts the priors of the positions after every move of the root with the small models (eagerChildPriors),
+     * so expanding the children of the root needs no model call of its own (see findChildPrior).
+     * Pawn moves and wall placements lead to positions of different models, each model is asked once for a batch.
+     * 
+     * @param root Root being expanded
+     * @param board Pointer to the board at @param root
+     * @return void
+     */
+    void predictChildPriors(Node* root, Board* board){
+        uint8_t moves[256];
+        size_t moveCount = 0;
+        board->generatePossibleMoves(root->player, moves, moveCount);
+
+        bool player = !root->player;
+        childPriors.resize(moveCount, 256);
+        childPriorRows.clear();
+        vector<input_vector> inputs;
+        vector<uint64_t> hashes;
+        int row = 0;
+
+        for(int wallPlacements = 0; wallPlacements < 2; wallPlacements++){
+            inputs.clear();
+            hashes.clear();
+            for(size_t i = 0; i < moveCount; i++){
+                if((moves[i] >> 7) != wallPlacements){
+                    continue;
+                }
 
-    Quoridor_GP whiteModels[21] = {};   ///<GP models used for white nodes
-    Quoridor_GP blackModels[21] = {};   ///<GP models used for black nodes
-    Quoridor_GP smallWhiteModels[21] = {};  ///<GP models used for white nodes (small)
-    Quoridor_GP smallBlackModels[21] = {};  ///<GP models used for black nodes (small)
+                board->executeMove(moves[i], root->player);
+                if(!board->getWinner()){
+                    inputs.push_back(board->toInputVector(player));
+                    hashes.push_back(board->zobristHash(player));
+                }
+                board->undoMove(moves[i], root->player);
+            }
+            if(inputs.empty()){
+                continue;
+            }
 
-    int rollouts = 50000;   ///<number of rollouts
-    int simulationsPerRollout = 3;  ///<simulations per rollout
+            int wallsOnBoard = 20 - board->whiteWalls - board->blackWalls + wallPlacements;
+            Quoridor_GP* model = player ? smallWhiteModels + wallsOnBoard : smallBlackModels + wallsOnBoard;
+            {
+                TELEMETRY(PhaseTimer timer(stats.gpSeconds); stats.gpCalls++; stats.gpPositions += inputs.size();)
+                childPriors.middleRows(row, inputs.size()) = model->predict_batch(inputs);
+            }
+            for(size_t b = 0; b < inputs.size(); b++){
+                childPriorRows[hashes[b]] = row + b;
+            }
+            row += inputs.size();
+        }
+    }
 
-    float mctsParameter = 0.25; ///<mcts parameter (c)
-    int rolloutPolicyParameter = 4; ///<rollout policy parameter
 
-    string modelDirectory = "GPmodels"; ///<directory of GP model save files
-    bool useModelForUCT = true; ///<model usage for UCT
-    int rolloutPolicyFunction = 2;  ///<rollout policy function used
+    /**
+     * Looks up the prior of a child of the root predicted by predictChildPriors.
+     * 
+     * @param node Leaf node to expand
+     * @param board Pointer to the board at @param node
+     * @param depth Depth of @param node
+     * @param prior Outputs the prior
+     * @return bool Whether the prior was found
+     */
+    bool findChildPrior(Node* node, Board* board, int depth, VectorXd& prior){
+        if(depth != 1 || childPriorRows.empty()){
+            return false;
+        }
+
+        auto row = childPriorRows.find(board->zobristHash(node->player));
+        if(row == childPriorRows.end()){
+            return false;
+        }
+        prior = childPriors.row(row->second).transpose();
+        return true;
+    }
+
 
     /**
-     * Loads in all the GP models from the model directory
+     * Exposes more children of a lazily expanded node, as its visit count grows (progressive widening).
      * 
-     * @param modelDirectory the directory of the models
+     * @param node Current node in the MCTS tree
+     * @param board Pointer to the board at @param node
+     * @param position Hashes of the position on @param board
      * @return void
      */
-    void loadModels() {
-        if (modelDirectory == ""){
+    void widen(Node* node, Board* board, PositionHash& position){
+        if(node->nextCandidate >= node->candidateCount){
             return;
         }
-        
-        std::filesystem::path modelDir = std::filesystem::absolute(modelDirectory);
-    
-        for (int i = 0; i < 21; i++) {
-            whiteModels[i] = Quoridor_GP::load((modelDir / ("whiteModel" + to_string(i))).string());
-            blackModels[i] = Quoridor_GP::load((modelDir / ("blackModel" + to_string(i))).string());
-            smallWhiteModels[i] = Quoridor_GP::load((modelDir / ("whiteModelSmall" + to_string(i))).string());
-            smallBlackModels[i] = Quoridor_GP::load((modelDir / ("blackModelSmall" + to_string(i))).string());
-        }
+
+        int visits = node->whiteWins + node->blackWins;
+        // Children proven lost don't count, so a node keeps exposing moves that may save it
+        int childLimit = max(1, (int) ceil(wideningFactor * pow((float) visits, wideningExponent))) + node->provenLosses;
+        bool mirrored = useTranspositions && node->hash != position.hash;
+        int childCount = node->childCount;
+        node->widen(board, childLimit, mirrored);
+        treeNodes += node->childCount - childCount;
     }
 
 
     /**
-     * Runs MCTS and returns the best move according to visit count.
-     * This is used when predicting agent's next move.
+     * Plays the move leading to a child on the board and steps to the child.
      * 
-     * @param state Current board state
-     * @param whiteTurn Whether it's white's turn
-     * @return uint8_t Best move determined by MCTS
+     * @param node Current node in the MCTS tree
+     * @param board Pointer to the board at @param node
+     * @param move Index of the child in @param node
+     * @param position Hashes of the position on @param board (updated)
+     * @return Node* Child of @param node
      */
-    uint8_t predictBestMove(Board state, bool whiteTurn){
-        // Speed up endgame decisions
-        bool playerHasNoWall = (whiteTurn && !state.whiteWalls) || (!whiteTurn && !state.blackWalls);
-        if(playerHasNoWall){
-            return state.generateMoveOnShortestPath(whiteTurn);
+    Node* descend(Node* node, Board* board, uint8_t move, PositionHash& position){
+        uint8_t boardMove = move;
+        bool mirrored = false;
+
+        if(useTranspositions){
+            // A node shared with the mirrored position indexes its children in its own orientation
+            if(node->hash != position.hash){
+                boardMove = Board::mirrorMove(move);
+                mirrored = true;
+            }
+
+            position = {
+                board->zobristHashAfterMove(position.hash, boardMove, node->player),
+                board->zobristHashAfterMove(position.mirroredHash, boardMove, node->player, true),
+                position.ply + 1
+            };
         }
 
-        Node* mctsTree = buildTree(state, whiteTurn);
-        uint8_t bestMove = mostVisitedMove(mctsTree);
+        board->executeMove(boardMove, node->player);
+        searchMoves.push_back(boardMove);
+        searchMirrored.push_back(mirrored);
+
+        Node* child = node->children[move];
+        if(useTranspositions && !child->key){
+            child = registerChild(node, move, position);
+        }
+
+        searchPath.push_back(child);
+        return child;
+    }
+
+
+    /**
+     * Registers a child in the transposition table on its first visit.
+     * If the position is already in the table, the child is replaced by the shared node.
+     * 
+     * @param node Parent node
+     * @param move Index of the child in @param node
+     * @param position Hashes of the position of the child
+     * @return Node* Node to use for the child
+     */
+    Node* registerChild(Node* node, uint8_t move, PositionHash& position){
+        Node* child = node->children[move];
+        uint64_t key = transpositions.key(position);
+
+        Node* shared = transpositions.find(key);
+        if(shared){
+            node->children[move] = shared;
+            shared->references++;
+            if(--child->references == 0){
+                delete child;
+                treeNodes--;
+            }
+            return shared;
+        }
 
-        delete(mctsTree);
-        return bestMove;
+        child->ply = position.ply;
+        child->hash = position.hash;
+        child->key = key;
+        transpositions.insert(key, child);
+        return child;
     }
 
 
     /**
-     * Runs MCTS and fills a distribution array with visit counts for all moves.
-     * This is used for data generation and data relabelling.
+     * Performs a single rollout simulation with the rollout policy of rolloutPolicyFunction.
+     * The moves are played on the board itself and undone before returning.
      * 
-     * @param state Current board state
-     * @param whiteTurn Whether it's white's turn
-     * @param distribution Array to fill with visit counts
-     * @return void
+     * @param board Game board to simulate on (restored)
+     * @param player true: white, false: black
+     * @param moves Optional output, the moves played are appended to it
+     * @return bool true if white wins, false if black wins
      */
-    void predictDistribution(Board state, bool whiteTurn, int* distribution){
-        Node *mctsTree = buildTree(state, whiteTurn);
-        nodeVisits(mctsTree, distribution);
-        delete(mctsTree);
+    bool rollout(Board* board, bool player, vector<uint8_t>* moves = nullptr){
+        return (this->*rolloutFunction(rolloutPolicyFunction))(board, player, moves);
     }
 
 
     /**
-     * Builds the MCTS tree from the given state.
+     * Performs a single rollout simulation, specialized for a rollout policy class (see rolloutFunction).
      * 
-     * @param state Initial board state
-     * @param whiteTurn Whether it's white's turn
-     * @return Node* Root of the built MCTS tree
+     * @param board Game board to simulate on (restored)
+     * @param player true: white, false: black
+     * @param moves Optional output, the moves played are appended to it
+     * @return bool true if white wins, false if black wins
      */
-    Node* buildTree(Board state, bool whiteTurn){
-        srand(time(NULL));
-        Node *root = new Node(nullptr, whiteTurn, 0);
-        Board board = Board(state);
-
-        int rolloutsCompleted = 0;
-        while(rollouts > rolloutsCompleted){
-            Node* leaf = findLeaf(root, &board);
-            vector<bool> simulationResult(simulationsPerRollout);
-            for(int i = 0; i < simulationsPerRollout; i++){
-                Board boardCopy = board;
-                simulationResult[i] = rollout(&boardCopy, leaf->player);
+    template<class Policy>
+    bool rolloutWith(Board* board, bool player, vector<uint8_t>* moves){
+        uint8_t journal[ROLLOUT_LENGTH];
+        int plies = 0;
+        bool whiteWon;
+
+        while(true){
+            if(rolloutCutoff && isQuiet(board, player, plies, whiteWon)){
+                break;
+            }
+            char provenWinner = tacticalRollouts && plies ? proveTactics(board, player) : 0;
+            if(provenWinner){
+                whiteWon = provenWinner == 'w';
+                break;
             }
 
-            int whiteWins = 0;
-            int blackWins = 0;
-
-            for(int i = 0; i < simulationsPerRollout; i++){
-                if(simulationResult[i]){
-                    whiteWins++;
-                }else{
-                    blackWins++;
-                }
+            uint8_t bestMove = Policy::move(*this, board, player);
+            if(decisiveRollouts){
+                bestMove = decisiveMove(board, player, bestMove);
             }
+            board->executeMove(bestMove, player);
+            journal[plies++] = bestMove;
+            if(moves){
+                moves->push_back(bestMove);
+            }
+            TELEMETRY(stats.rolloutPlies++;)
 
-            backpropagate(leaf, whiteWins, blackWins);
+            player = !player;
 
-            board = state;
-            rolloutsCompleted++;
+            if(board->getWinner()){
+                whiteWon = board->getWinner() == 'w';
+                break;
+            }
+            if(plies == ROLLOUT_LENGTH){
+                whiteWon = board->whiteCloser(player);
+                break;
+            }
         }
 
-        return root;
+        while(plies > 0){
+            player = !player;
+            board->undoMove(journal[--plies], player);
+        }
+        return whiteWon;
     }
 
 
     /**
-     * Traverses the MCTS tree to find a leaf node to expand.
-     * Applies UCT to descend, and expands node if not terminal.
-     * Optionally uses GP model for expansion guidance.
+     * Corrects the move of the rollout policy when the game is about to be decided: a pawn move winning on the spot
+     * is played at once, and a wall placed while the opponent could win with their next move is one stopping them.
+     * Both are only looked for when a pawn is within two rows of its goal (see Board::winningPawnMove).
      * 
-     * @param node Current node in the MCTS tree
-     * @param board Pointer to the board being simulated
-     * @return Node* Leaf node ready for simulation
+     * @param board Game board
+     * @param player true: white, false: black
+     * @param move Move chosen by the rollout policy
+     * @return uint8_t Move to play
      */
-    Node* findLeaf(Node* node, Board* board){
-        int depth = 0;
-        while(node->expanded){
-            uint8_t bestMove = bestUCT(node);
+    uint8_t decisiveMove(Board* board, bool player, uint8_t move){
+        uint8_t winningMove = board->winningPawnMove(player);
+        if(winningMove){
+            return winningMove;
+        }
+        if(!(move >> 7) || !board->winningPawnMove(!player)){
+            return move;
+        }
 
-            board->executeMove(bestMove, node->player);
+        uint8_t blockingWalls[16];
+        size_t wallCount = 0;
+        board->generateBlockingWalls(player, blockingWalls, wallCount);
+        return wallCount ? blockingWalls[random.below(wallCount)] : move;
+    }
 
-            node = node->children[bestMove];
 
-            depth++;
+    /**
+     * Proves a position with a shallow alpha-beta (tacticalDepth plies, see Minimax::provePosition).
+     * The search only runs in sharp endgames, where a pawn is close enough to its goal to finish within the depth,
+     * any other position cannot be proven by it.
+     * 
+     * @param board Game board
+     * @param player Player to move, true: white, false: black
+     * @return char 'w' / 'b' if the position is proven won by white / black, 0 if not
+     */
+    char proveTactics(Board* board, bool player){
+        int moverPath = board->bfs(player);
+        int opponentPath = board->bfs(!player);
+        if(moverPath > (tacticalDepth + 1) / 2 && opponentPath > tacticalDepth / 2){
+            return 0;
         }
 
-        // When a board has a winner, it must be a leaf
-        if(board->getWinner() != 0){
-            return node;
+        TELEMETRY(stats.tacticalSearches++;)
+        int result = Minimax(tacticalDepth).provePosition(board, player);
+        if(!result){
+            return 0;
         }
 
-        int wallsOnBoard = 20 - board->blackWalls - board->whiteWalls;
-        Quoridor_GP* model = nullptr;
-        if (useModelForUCT) {
-            if(depth <= 1) model = node->player ? smallWhiteModels + wallsOnBoard : smallBlackModels + wallsOnBoard;
-            if(depth == 0) model = node->player ? whiteModels + wallsOnBoard : blackModels + wallsOnBoard;
-        }
+        TELEMETRY(stats.tacticalProofs++;)
+        return (result > 0) == player ? 'w' : 'b';
+    }
 
-        int simulations = rollouts * simulationsPerRollout;
-        node->expandNode(board, depth ? (simulations >> 10) : (simulations >> 6), model);
-        uint8_t bestMove = bestUCT(node);
 
-        board->executeMove(bestMove, node->player);
+    /**
+     * Decides if a truncated rollout (rolloutCutoff) stops, and draws its result from an evaluation if it does.
+     * The lead is only checked every CUTOFF_CHECK_INTERVAL plies (see evaluateCutoff), as it takes two BFS.
+     * 
+     * @param board Game board
+     * @param player Player to move, true: white, false: black
+     * @param plies Plies played by the rollout
+     * @param whiteWon Outputs the result if the rollout stops
+     * @return bool true if the rollout stops
+     */
+    bool isQuiet(Board* board, bool player, int plies, bool& whiteWon){
+        bool wallsLeft = board->whiteWalls || board->blackWalls;
+        if(wallsLeft && plies < rolloutCutoff && plies % CUTOFF_CHECK_INTERVAL){
+            return false;
+        }
 
-        node = node->children[bestMove];
-        return node;
+        return evaluateCutoff(board->bfs(true), board->bfs(false), board->whiteWalls, board->blackWalls, player, plies, whiteWon);
     }
 
 
     /**
-     * Performs a single rollout simulation.
+     * Decides if a truncated rollout stops, and draws its result from an evaluation if it does.
+     * A rollout stops after rolloutCutoff plies, when no walls are left (the race is decided by path lengths),
+     * or when a side leads by cutoffMargin plies.
+     * The lead counts path lengths, the move of @param player and the walls in hand (cutoffWallValue),
+     * and is mapped to the win probability of white with a logistic curve (cutoffScale).
      * 
-     * @param board Game board to simulate on
-     * @param player true: white, false: black
-     * @return bool true if white wins, false if black wins
+     * @param whitePath Path length of the white pawn
+     * @param blackPath Path length of the black pawn
+     * @param whiteWalls Walls in hand of white
+     * @param blackWalls Walls in hand of black
+     * @param player Player to move, true: white, false: black
+     * @param plies Plies played by the rollout
+     * @param whiteWon Outputs the result if the rollout stops
+     * @return bool true if the rollout stops
      */
-    bool rollout(Board* board, bool player){
-        for(int i = 0; i < 40; i++){
-            uint8_t bestMove = rolloutPolicy(board, player);
-            board->executeMove(bestMove, player);
-
-            player = !player;
+    bool evaluateCutoff(int whitePath, int blackPath, int whiteWalls, int blackWalls, bool player, int plies, bool& whiteWon){
+        // The player to move wins a race of equal paths
+        float lead = blackPath - whitePath + (player ? 0.5f : -0.5f);
+        if(!whiteWalls && !blackWalls){
+            whiteWon = lead > 0;
+            return true;
+        }
 
-            if(board->getWinner()){
-                return board->getWinner() == 'w';
-            }
+        lead += cutoffWallValue * (whiteWalls - blackWalls);
+        if(plies < rolloutCutoff && fabs(lead) < cutoffMargin){
+            return false;
         }
 
-        return board->whiteCloser(player);
+        whiteWon = random.uniform() * (1 + exp(-lead / cutoffScale)) < 1;
+        return true;
     }
 
 
@@ -335,14 +3413,16 @@ class MCTS
      * @return uint8_t Sampled move
      */
     uint8_t generateMoveFromModel(Board* board, bool player, Quoridor_GP* model){
-        VectorXd pred = model->predict(board->toInputVector(player));
+        TELEMETRY(stats.gpCalls++; stats.gpPositions++;)
+        board->toInputVector(player, scratch.input);
+        const VectorXd& pred = model->predict(scratch.input, scratch.gp);
 
         for(int i = 0; i < 10; i++){
             // If prediction is a uniform distribution, do not bother (may choose illegal move), this was fun to debug...
             if (pred(0) > 0){
                 break;
             }
-            double r = ((double) rand() /(RAND_MAX));
+            double r = random.uniform();
             int move = 0;
 
             for(;move < 256; move++){
@@ -377,7 +3457,7 @@ class MCTS
         board->generatePossibleMovesUnchecked(player, possibleMoves, moveCount);
 
         while(tries < 3){
-            uint8_t move = possibleMoves[rand() % moveCount];
+            uint8_t move = possibleMoves[random.below(moveCount)];
 
             if(move >> 7){
                 uint8_t wallPlacement = move & 0b01111111;
@@ -408,17 +3488,17 @@ class MCTS
 
         int pawnMoves = board->generatePossibleMovesUnchecked(player, possibleMoves, moveCount);
 
-        bool pawnMove = possibleMoves[rand() % 2];
+        bool pawnMove = possibleMoves[random.below(2)];
 
         if (pawnMove == 0){
-            uint8_t move = possibleMoves[rand() % pawnMoves];
+            uint8_t move = possibleMoves[random.below(pawnMoves)];
 
             return move;
         }
 
         // we can get a pawn move here as well, but I don't care!
         while(tries < 3){
-            uint8_t move = possibleMoves[rand() % moveCount];
+            uint8_t move = possibleMoves[random.below(moveCount)];
 
             if(move >> 7){
                 uint8_t wallPlacement = move & 0b01111111;
@@ -447,7 +3527,7 @@ class MCTS
         uint8_t possibleMoves[256];
         size_t moveCount = 0;
 
-        bool pawnMove = rand() % rolloutPolicyParameter;
+        bool pawnMove = random.below(rolloutPolicyParameter);
 
         if (pawnMove != 0){
             return board->generateMoveOnShortestPath(player);
@@ -458,7 +3538,7 @@ class MCTS
         int tries = 0;
         // we can get the pawn move here as well, but I don't care!
         while(tries < 3){
-            uint8_t move = possibleMoves[rand() % moveCount];
+            uint8_t move = possibleMoves[random.below(moveCount)];
 
             if(move >> 7){
                 uint8_t wallPlacement = move & 0b01111111;
@@ -482,47 +3562,87 @@ class MCTS
         return move;
     }
 
+
+    /**
+     * Rollout policy classes, the rollout loop is instantiated for each of them so the policy is inlined into it.
+     */
+    struct FullRandomPolicy {
+        static uint8_t move(MCTS& mcts, Board* board, bool player){
+            return mcts.rolloutPolicy_fullRandom(board, player);
+        }
+    };
+
+    struct HalfPawnPolicy {
+        static uint8_t move(MCTS& mcts, Board* board, bool player){
+            return mcts.rolloutPolicy_halfProbabilityOfPawnMovement(board, player);
+        }
+    };
+
+    struct BestPawnPolicy {
+        static uint8_t move(MCTS& mcts, Board* board, bool player){
+            return mcts.rolloutPolicy_BestPawnMovement(board, player);
+        }
+    };
+
+    struct GPPolicy {
+        static uint8_t move(MCTS& mcts, Board* board, bool player){
+            return mcts.rolloutPolicy_GP(board, player);
+        }
+    };
+
+    typedef bool (MCTS::*RolloutFunction)(Board*, bool, vector<uint8_t>*);
+
+
     /**
-     * Main rollout policy function. Chooses between shortest path move, GP model, or fallback.
-     * Similar to rolloutPolicy_BestPawnMovement
+     * Rollout factory, maps a rolloutPolicyFunction value to the rollout loop specialized for its policy.
      * 
-     * @param board Current game board
-     * @param player Current player (true: white, false: black)
-     * @return uint8_t Move to execute
+     * @param policy 0: full random, 1: 50% pawn movement, 2: best pawn movement (also any unknown value), 3: GP
+     * @return RolloutFunction Rollout loop of the policy
      */
-    uint8_t rolloutPolicy(Board* board, bool player){
-        switch (rolloutPolicyFunction)
+    static RolloutFunction rolloutFunction(int policy){
+        switch (policy)
         {
         case 0:
-            return rolloutPolicy_fullRandom(board, player);
-        
+            return &MCTS::rolloutWith<FullRandomPolicy>;
+
         case 1:
-            return rolloutPolicy_halfProbabilityOfPawnMovement(board, player);
-        
-        case 2:
-            return rolloutPolicy_BestPawnMovement(board, player);
-        
+            return &MCTS::rolloutWith<HalfPawnPolicy>;
+
         case 3:
-            return rolloutPolicy_GP(board, player);
+            return &MCTS::rolloutWith<GPPolicy>;
         }
 
-        return 0;
+        return &MCTS::rolloutWith<BestPawnPolicy>;
     }
 
 
     /**
-     * Backpropagates the simulation result up the tree.
+     * Backpropagates the simulation result along the selected path.
      * 
-     * @param node Node from which to start backpropagation
+     * @param path Nodes visited from the root to the simulated leaf
      * @param whiteWins Number of white wins to propagate
      * @param blackWins Number of black wins to propagate
      * @return void
      */
-    void backpropagate(Node* node, int whiteWins, int blackWins){
-        while(node){
-            node->whiteWins += whiteWins;
-            node->blackWins += blackWins;
-            node = node->parent;
+    void backpropagate(vector<Node*>& path, int whiteWins, int blackWins){
+        TELEMETRY(PhaseTimer timer(stats.backpropagationSeconds);)
+        for(Node* node : path){
+            node->addResults(whiteWins, blackWins);
+        }
+    }
+
+
+    /**
+     * Propagates the proof of the last node of a path towards the root, as long as the parents become proven.
+     * 
+     * @param path Nodes visited from the root to a proven node
+     * @return void
+     */
+    void propagateProof(vector<Node*>& path){
+        for(int i = (int) path.size() - 2; i >= 0; i--){
+            if(!path[i]->updateProof()){
+                break;
+            }
         }
     }
 
@@ -536,6 +3656,10 @@ class MCTS
     uint8_t bestUCT(Node* node){
         float bestValue = -1;
         uint8_t bestMove = 0;
+        // A shared node can be visited through other parents before its parent is visited
+        float parentSqrtLogVisits = UCT_TABLES.sqrtLogOf(max(node->whiteWins + node->blackWins, 1));
+        char mover = node->player ? 'w' : 'b';
+        uint8_t provenLoss = 0;
 
         for (int move = 0; move < 256; move++){
             Node* child = node->children[move];
@@ -543,7 +3667,16 @@ class MCTS
                 continue;
             }
 
-            float value = child->getValue(node->player, mctsParameter);
+            // Proven wins are taken right away, proven losses are only chosen if nothing else is left
+            if(child->provenWinner){
+                if(child->provenWinner == mover){
+                    return move;
+                }
+                provenLoss = move;
+                continue;
+            }
+
+            float value = child->getValue(node->player, mctsParameter, parentSqrtLogVisits, rave ? raveEquivalence : 0);
 
             if(value == -1){
                 return move;
@@ -555,6 +3688,10 @@ class MCTS
             }
         }
 
+        if(!bestMove && provenLoss){
+            return provenLoss;
+        }
+
         if(!bestMove){
             cout << "bestUCT infinite loop\n";
             bestMove = bestUCT(node);
@@ -571,8 +3708,10 @@ class MCTS
      * @return uint8_t Move index with the highest number of visits
      */
     uint8_t mostVisitedMove(Node* node){
-        int bestValue = -1;
+        int bestValue = INT_MIN;
         uint8_t bestMove = 0;
+        char mover = node->player ? 'w' : 'b';
+        char opponent = node->player ? 'b' : 'w';
 
         for (int move = 0; move < 256; move++){
             Node* child = node->children[move];
@@ -580,8 +3719,18 @@ class MCTS
                 continue;
             }
 
-            if(child->whiteWins + child->blackWins > bestValue){
-                bestValue = child->whiteWins + child->blackWins;
+            // A proven win beats any visit count, a proven loss is only played when every move loses
+            if(child->provenWinner == mover){
+                return move;
+            }
+
+            int visits = child->whiteWins + child->blackWins;
+            if(child->provenWinner == opponent){
+                visits -= INT_MAX / 2;
+            }
+
+            if(visits > bestValue){
+                bestValue = visits;
                 bestMove = move;
             }
         }
@@ -618,9 +3767,11 @@ class MCTS
      * @param modelDirectory Directory containing the GP models
      * @param useModelForUCT Whether to use a GP model in UCT selection
      * @param rolloutPolicyFunction What rollout policy to use
+     * @param reuseTree Whether to keep the search tree between decisions
      */
-    MCTS(int rollouts = 50000, int simulationsPerRollout = 5, float mctsParameter = 0.5, int rolloutPolicyParameter = 4, string modelDirectory = "GPmodels", bool useModelForUCT = true, int rolloutPolicyFunction = 2){
+    MCTS(int rollouts = 50000, int simulationsPerRollout = 5, float mctsParameter = 0.5, int rolloutPolicyParameter = 4, string modelDirectory = "GPmodels", bool useModelForUCT = true, int rolloutPolicyFunction = 2, bool reuseTree = true){
         this->rollouts = rollouts;
+        this->expectedRollouts = rollouts;
         this->simulationsPerRollout = simulationsPerRollout;
 
         this->mctsParameter = mctsParameter;
@@ -629,160 +3780,28 @@ class MCTS
         this->modelDirectory = modelDirectory;
         this->useModelForUCT = useModelForUCT;
         this->rolloutPolicyFunction = rolloutPolicyFunction;
+        this->reuseTree = reuseTree;
+
+        // The paths are swapped with those of pending leaves, so they all start with the same capacity
+        searchPath.reserve(SEARCH_PATH_CAPACITY);
+        searchMoves.reserve(SEARCH_PATH_CAPACITY);
+        searchMirrored.reserve(SEARCH_PATH_CAPACITY);
+        raveMoves.reserve(SEARCH_PATH_CAPACITY + ROLLOUT_LENGTH);
 
         loadModels();
     }
-};
-
-
-/**
- * Minimax agent
- */
-class Minimax {
-    public:
 
-    int minmaxDepth;    ///<depth of minimax search
 
-    /**
-     * Does minimax with alpha-beta pruning
-     * 
-     * @param board board
-     * @param depth simulation depth
-     * @param player true: white, false: black
-     * @param alpha alpha value
-     * @param beta beta value
-     * return minimax value
-     */
-    float minimax(Board* board, int depth, bool player, float alpha, float beta){
-    
-        if (depth == 0){
-            return board->evaluate();
-        }
-    
-        if(player){
-            float maxValue = -1000.0f;
-            uint8_t moves[256] = {0};
-            size_t movesCount = 0; 
-            board->generatePossibleMoves(player, moves, movesCount);
-            
-            for (int i = 0; i < movesCount; i++){
-                uint8_t move = moves[i];
-    
-                board->executeMove(move, player);
-                maxValue = max(maxValue, minimax(board, depth - 1, !player, alpha, beta));
-                board->undoMove(move, player);
-    
-                alpha = max(alpha, maxValue);
-    
-                if (maxValue > beta){
-                    break;
-                }
-            }
-            return maxValue;
-        }
-    
-        if(!player){
-            float minValue = 1000.0f;
-            uint8_t moves[256] = {0};
-            size_t movesCount = 0; 
-            board->generatePossibleMoves(player, moves, movesCount);
-            
-            for (int i = 0; i < movesCount; i++){
-                uint8_t move = moves[i];
-    
-                board->executeMove(move, player);
-                minValue = min(minValue, minimax(board, depth - 1, !player, alpha, beta));
-                board->undoMove(move, player);
-    
-                beta = min(beta, minValue);
-    
-                if(minValue < alpha){
-                    break;
-                }
-            }
-            return minValue;
-        }
-    
-        return 0;
-    }
-    
+    // The ponder thread holds this pointer and works on searchTree, so an agent stays where it was constructed
+    MCTS(MCTS&& other) = delete;
+    MCTS& operator=(MCTS&& other) = delete;
 
-    /**
-     * Predicts best move for a given board position and player
-     * 
-     * @param board board
-     * @param depth simulation depth
-     * return predicted best move
-     */
-    uint8_t predictBestMove(Board* board, bool player){
-        int depth = minmaxDepth;
-        uint8_t bestMove;
-    
-        float alpha = -2000.0f;
-        float beta = 2000.0f;
-    
-        if (depth == 0){
-            return board->evaluate();
-        }
-    
-        if(player){
-            float maxValue = -2000.0f;
-    
-            uint8_t moves[256] = {0};
-            size_t movesCount = 0; 
-            board->generatePossibleMoves(player, moves, movesCount);
-            
-            for (int i = 0; i < movesCount; i++){
-                uint8_t move = moves[i];
-    
-                board->executeMove(move, player);
-                float value = minimax(board, depth - 1, !player, alpha, beta);
-                if(value > maxValue){
-                    bestMove = move;
-                    maxValue = value;
-                }
-                board->undoMove(move, player);
-                alpha = max(alpha, maxValue);
-    
-                if (maxValue > beta){
-                    break;
-                }
-            }
-        }
-    
-        if(!player){
-            float minValue = 2000.0f;
-    
-            uint8_t moves[256] = {0};
-            size_t movesCount = 0;
-            board->generatePossibleMoves(player, moves, movesCount);
-            
-            for (int i = 0; i < movesCount; i++){
-                uint8_t move = moves[i];
-                board->executeMove(move, player);
-                float value = minimax(board, depth - 1, !player, alpha, beta);
-                if(value < minValue){
-                    bestMove = move;
-                    minValue = value;
-                }
-                board->undoMove(move, player);
-                beta = min(beta, minValue);
-    
-                if(minValue < alpha){
-                    break;
-                }
-            }
-        }
-    
-        
-        return bestMove;
-    }
 
     /**
-     * Minimax constructor
+     * MCTS destructor
+     * Stops pondering, the kept search tree is freed by its owner
      */
-    Minimax(int minimaxDepth){
-        this->minmaxDepth = minimaxDepth;
+    ~MCTS(){
+        stopPondering();
     }
-
 };
\ No newline at end of file
@@ -4,16 +4,61 @@
 #include <string>
 #include <fstream>
 #include <cstdio>
+#include <deque>
 
 using namespace std::chrono;
 
 
+// Heap allocations made while COUNT_ALLOCATIONS is set, counted by the malloc wrappers below (see testHotPathAllocations)
+// Eigen and the tree allocate through malloc directly, so counting operator new would not see them
+atomic<bool> COUNT_ALLOCATIONS(false);
+atomic<long long> HEAP_ALLOCATIONS(0);
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+extern "C" void* malloc(size_t size){
+    if(COUNT_ALLOCATIONS.load(memory_order_relaxed)){
+        HEAP_ALLOCATIONS.fetch_add(1, memory_order_relaxed);
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size){
+    if(COUNT_ALLOCATIONS.load(memory_order_relaxed)){
+        HEAP_ALLOCATIONS.fetch_add(1, memory_order_relaxed);
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size){
+    if(COUNT_ALLOCATIONS.load(memory_order_relaxed)){
+        HEAP_ALLOCATIONS.fetch_add(1, memory_order_relaxed);
+    }
+    return __libc_realloc(pointer, size);
+}
+
+
+/**
+ * Count the heap allocations of a function
+ */
+template<typename Function>
+long long countAllocations(Function function){
+    HEAP_ALLOCATIONS.store(0);
+    COUNT_ALLOCATIONS.store(true);
+    function();
+    COUNT_ALLOCATIONS.store(false);
+    return HEAP_ALLOCATIONS.load();
+}
+
+
 /**
  * Simulate game between two agents
  */
-bool simulateGame(Board board, MCTS agent1, MCTS agent2, bool whiteMove){
+bool simulateGame(Board board, MCTS& agent1, MCTS& agent2, bool whiteMove){
     for (int i = 0; i < 200 && !board.getWinner(); i++){
-        MCTS agent = whiteMove ? agent1 : agent2;
+        MCTS& agent = whiteMove ? agent1 : agent2;
 
         uint8_t bestMove = agent.predictBestMove(board, whiteMove);
         board.executeMove(bestMove, whiteMove);
@@ -38,7 +83,7 @@ bool simulateGame(Board board, MCTS agent1, MCTS agent2, bool whiteMove){
 /**
  * Contest two agents
  */
-int contestModels(MCTS agent1, MCTS agent2){
+int contestModels(MCTS& agent1, MCTS& agent2){
     bool results[16];
 
     // Starting State
@@ -220,10 +265,10 @@ void testSize(){
     
     int rollouts[5] = {1000, 2000, 5000, 10000, 25000};
 
-    MCTS agents[5];
+    deque<MCTS> agents;
 
     for(int i = 0; i < 5; i++){
-        agents[i] = MCTS(rollouts[i], 3, 0.25, 4, "GPmodels", true, 2);
+        agents.emplace_back(rollouts[i], 3, 0.25, 4, "GPmodels", true, 2);
     }
 
     for(int i = 0; i < 5; i++){
@@ -255,11 +300,11 @@ void testSimulationsPerRolloutBySimulations(){
     int simulations = 12000;
     int simulationsPerRollout[5] = {1, 2, 3, 5, 10};
 
-    MCTS agents[5];
+    deque<MCTS> agents;
 
     for(int i = 0; i < 5; i++){
         int rollouts = simulations / simulationsPerRollout[i];
-        agents[i] = MCTS(rollouts, simulationsPerRollout[i], 0.25, 4, "GPmodels", true, 2);
+        agents.emplace_back(rollouts, simulationsPerRollout[i], 0.25, 4, "GPmodels", true, 2);
     }
 
     for(int i = 0; i < 5; i++){
@@ -291,10 +336,10 @@ void testMCTSParam(){
     double MCTSParams[13] = {0.05, 0.1, 0.5, 0.75, 1, 1.25, 1.5, 1.75, 2, 2.5, 3, 4, 5};
 
     MCTS challenger = MCTS(10000, 3, 0.25, 4, "GPmodels", true, 2);
-    MCTS agents[13];
+    deque<MCTS> agents;
 
     for(int i = 0; i < 13; i++){
-        agents[i] = MCTS(10000, 3, MCTSParams[i], 4, "GPmodels", true, 2);
+        agents.emplace_back(10000, 3, MCTSParams[i], 4, "GPmodels", true, 2);
     }
 
     for(int i = 0; i < 13; i++){
@@ -321,10 +366,10 @@ void testRolloutPolicyParam(){
     int rolloutPolicyParams[6] = {2, 3, 5, 6, 7, 8};
 
     MCTS challenger = MCTS(1000, 3, 0.25, 4, "GPmodels", true, 2);
-    MCTS agents[6];
+    deque<MCTS> agents;
 
     for(int i = 0; i < 6; i++){
-        agents[i] = MCTS(1000, 3, 0.25, rolloutPolicyParams[i], "GPmodels", true, 2);
+        agents.emplace_back(1000, 3, 0.25, rolloutPolicyParams[i], "GPmodels", true, 2);
     }
 
     for(int i = 0; i < 6; i++){
@@ -343,7 +388,7 @@ void testRolloutPolicyParam(){
 /**
  * Calculate decision time for model
  */
-double caculateDecisionTime(MCTS agent, int simulations = 10){
+double caculateDecisionTime(MCTS& agent, int simulations = 10){
     Board board = Board();
     auto start = high_resolution_clock::now();
 
@@ -367,18 +412,236 @@ void testDecisionTime(){
     // Same rollouts as Lee's agents
     int rollouts[4] = {2500, 7500, 20000, 60000};
     for(int i = 0; i < 4; i++){
-        agent = MCTS(rollouts[i], 1, 0.25, 4, "GPmodels", true, 2);
-        double decisionTime = caculateDecisionTime(agent);
+        // Tree reuse would carry the previous decision's tree over and skew the measurement, so would stopping early
+        MCTS timed = MCTS(rollouts[i], 1, 0.25, 4, "GPmodels", true, 2, false);
+        timed.earlyStop = false;
+        double decisionTime = caculateDecisionTime(timed);
         saveFile << decisionTime << endl;
     }
 }
 
 
+/**
+ * Count the allocations a tree is made of: its nodes, their children arrays and lazy expansion candidates,
+ * and the duplicate nodes discarded when a transposition led to a node already in the tree (one per extra reference)
+ */
+long long treeAllocations(Node* node, unordered_set<Node*>& counted){
+    if(!counted.insert(node).second){
+        return 0;
+    }
+
+    long long allocations = node->references;
+    if(node->candidates){
+        allocations += 2;
+    }
+    if(!node->children){
+        return allocations;
+    }
+
+    allocations++;
+    for(int move = 0; move < 256; move++){
+        if(node->children[move]){
+            allocations += treeAllocations(node->children[move], counted);
+        }
+    }
+    return allocations;
+}
+
+
+/**
+ * Test that the hot path of the search does not allocate: once a search has warmed up the buffers of the agent,
+ * a search allocates nothing but its tree and the entries of its transposition table, and rollouts allocate nothing at all
+ * 
+ * @return bool Whether every configuration passed
+ */
+bool testHotPathAllocations(){
+    string saveFileName = "testResults/hotPathAllocations";
+    remove(saveFileName.c_str());
+    ofstream saveFile(saveFileName);
+
+    // The Standard Opening
+    Board board = Board();
+    board.executeMove(24, true);
+    board.executeMove(16, false);
+    board.executeMove(24, true);
+    board.executeMove(16, false);
+    board.executeMove(24, true);
+    board.executeMove(16, false);
+    board.executeMove(0b11010100, true);
+
+    string names[8] = {"batched priors", "single priors", "GP rollouts", "lockstep rollouts", "rave", "no widening", "no model", "no transpositions"};
+    bool passed = true;
+    for(int i = 0; i < 8; i++){
+        MCTS tested = MCTS(2000, 3, 0.25, 4, "GPmodels", i != 6, i == 2 ? 3 : 2, false);
+        tested.useTranspositions = i != 7;
+        tested.earlyStop = false;
+        tested.priorBatchSize = i == 1 ? 1 : 8;
+        tested.lockstepRollouts = i == 3;
+        tested.decisiveRollouts = i != 3;
+        tested.rave = i == 4;
+        tested.progressiveWidening = i != 5;
+
+        // The same seed grows the same tree, so the transposition table already has the buckets the measured search needs
+        tested.random.seed(1);
+        delete tested.buildTree(board, false);
+        tested.random.seed(1);
+        Node* root = nullptr;
+        long long searchAllocations = countAllocations([&](){ root = tested.buildTree(board, false); });
+        unordered_set<Node*> counted;
+        searchAllocations -= treeAllocations(root, counted) + tested.transpositions.nodes.size();
+        delete root;
+
+        long long rolloutAllocations = countAllocations([&](){
+            for(int j = 0; j < 100; j++){
+                Board rolloutBoard = board;
+                tested.rollout(&rolloutBoard, false);
+            }
+        });
+
+        passed = passed && !searchAllocations && !rolloutAllocations;
+        saveFile << names[i] << ":\t" << searchAllocations << "\t" << rolloutAllocations << endl;
+        cout << names[i] << ": " << searchAllocations << " allocations besides the tree in a search, "
+             << rolloutAllocations << " in 100 rollouts" << endl;
+    }
+    return passed;
+}
+
+
+/**
+ * Test the boards of RolloutBatch against Board on random positions: the path lengths and shortest path steps
+ * found by flood, the wall placements it accepts, and the pawn moves of stepPawn
+ * 
+ * @return bool Whether the batch agreed with Board everywhere
+ */
+bool testRolloutBatch(){
+    FastRandom random(12345);
+    RolloutBatch batch;
+    int mismatches = 0;
+    int lanesChecked = 0;
+
+    for(int round = 0; round < 200; round++){
+        // Random positions of different lengths, walls included
+        Board boards[ROLLOUT_LANES];
+        bool players[ROLLOUT_LANES];
+        batch.clear();
+        for(int lane = 0; lane < ROLLOUT_LANES; lane++){
+            Board board = Board();
+            bool player = true;
+            int plies = random.below(60);
+            for(int ply = 0; ply < plies; ply++){
+                uint8_t moves[256];
+                size_t moveCount = 0;
+                board.generatePossibleMoves(player, moves, moveCount);
+                uint8_t move = moves[random.below(moveCount)];
+                board.executeMove(move, player);
+                if(board.getWinner()){
+                    board.undoMove(move, player);
+                    break;
+                }
+                player = !player;
+            }
+            boards[lane] = board;
+            players[lane] = player;
+            batch.add(board, player);
+        }
+
+        bool active[ROLLOUT_LANES];
+        fill(active, active + ROLLOUT_LANES, true);
+        batch.flood(active);
+
+        for(int lane = 0; lane < ROLLOUT_LANES; lane++){
+            Board& board = boards[lane];
+            lanesChecked++;
+
+            for(int side = 0; side < 2; side++){
+                bool white = side == 0;
+                int distance = board.bfs(white);
+                if(batch.distance[side][lane] != distance){
+                    mismatches++;
+                    continue;
+                }
+
+                // A step starts a shortest path if the cell it leads to is one step closer to the goal
+                static const int offsets[4] = {UP, DOWN, LEFT, RIGHT};
+                static const int cellOffsets[4] = {16, -16, -1, 1};
+                uint8_t pawn = white ? board.whitePawn : board.blackPawn;
+                uint8_t expected = 0;
+                for(int direction = 0; direction < 4; direction++){
+                    int i = (pawn >> 4) + (direction == 0) - (direction == 1);
+                    int j = (pawn & 0xf) + (direction == 3) - (direction == 2);
+                    if(i < 0 || i > 8 || j < 0 || j > 8 || board.walledOffCells[pawn + offsets[direction]]){
+                        continue;
+                    }
+
+                    Board stepped = board;
+                    (white ? stepped.whitePawn : stepped.blackPawn) = pawn + cellOffsets[direction];
+                    expected |= (stepped.bfs(white) == distance - 1) << direction;
+                }
+                mismatches += distance && batch.steps[side][lane] != expected;
+            }
+        }
+
+        // Wall placements: the batch accepts a free place exactly when Board finds it valid
+        for(int lane = 0; lane < ROLLOUT_LANES; lane++){
+            Board& board = boards[lane];
+            for(int tries = 0; tries < 8; tries++){
+                uint8_t wallPlacement = random.below(128);
+                if(board.takenWallPlaces[wallPlacement]){
+                    continue;
+                }
+
+                bool single[ROLLOUT_LANES] = {false};
+                single[lane] = true;
+                batch.placeWall(lane, wallPlacement);
+                batch.flood(single);
+                bool accepted = batch.distance[0][lane] != PATH_BLOCKED && batch.distance[1][lane] != PATH_BLOCKED;
+                mismatches += accepted != board.isValidWallPlacement(wallPlacement);
+                batch.removeWall(lane, wallPlacement);
+            }
+        }
+
+        // Pawn steps: the pawn of the player to move lands on a cell Board allows
+        batch.flood(active);
+        for(int lane = 0; lane < ROLLOUT_LANES; lane++){
+            Board& board = boards[lane];
+            bool white = players[lane];
+            uint8_t pawn = white ? board.whitePawn : board.blackPawn;
+            batch.stepPawn(lane, random);
+            uint8_t stepped = white ? batch.whitePawn[lane] : batch.blackPawn[lane];
+
+            uint8_t moves[8];
+            size_t moveCount = 0;
+            board.generatePossiblePawnMoves(white, moves, moveCount);
+            bool legal = false;
+            for(size_t k = 0; k < moveCount; k++){
+                uint8_t cell = pawn;
+                (moves[k] & 8) ? cell += (moves[k] & 48) : cell -= (moves[k] & 48);
+                (moves[k] & 4) ? cell += (moves[k] & 3) : cell -= (moves[k] & 3);
+                legal = legal || cell == stepped;
+            }
+            mismatches += !legal;
+        }
+    }
+
+    cout << "rollout batch: " << mismatches << " mismatches with Board in " << lanesChecked << " positions" << endl;
+    return !mismatches;
+}
+
+
 int main(int argc, char const* argv[]) {
     auto start = high_resolution_clock::now();
     auto end = high_resolution_clock::now();
     duration<double> elapsed = end - start;
     
+    if(!testHotPathAllocations()){
+        cout << "The search hot path allocates" << endl;
+        return 1;
+    }
+    if(!testRolloutBatch()){
+        cout << "RolloutBatch disagrees with Board" << endl;
+        return 1;
+    }
+
     testMCTSParam();
     testRolloutPolicyParam();
 
@@ -392,7 +655,7 @@ int main(int argc, char const* argv[]) {
     end = high_resolution_clock::now();
     elapsed = end - start;
     cout << "Elapsed time: " << elapsed.count() / 3600 << " hours" << endl;
-
+    return 0;
 }
 
 
@@ -19,7 +19,7 @@ bool simulateGame(Board board, int rolloutPolicyParameter1, float mctsParameter1
 
     // simulation loop
     for (int i = 0; i < 40 && !board.getWinner(); i++){
-        MCTS agent = whiteMove ? agent1 : agent2;
+        MCTS& agent = whiteMove ? agent1 : agent2;
 
         uint8_t bestMove = agent.predictBestMove(board, whiteMove);
         board.executeMove(bestMove, whiteMove);
@@ -175,7 +175,6 @@ void mctsHyperParameterSearch(int& rolloutPolicyParameter, float& mctsParameter)
   */
 void createDataset() {
     // Only use before first iteration, do not recreate the dataset.
-    srand(time(NULL));
     createDataSetNatural();
 
     padDataSetArtificially(true, "datasets/datasetWhite");
@@ -197,6 +196,8 @@ void relabelDatasetFile(const string& filename, bool player) {
     size_t size = 0;
 
     MCTS agent = MCTS(ROLLOUTS, SIMULATIONS_PER_ROLLOUT, MCTS_PARAMETER, ROLLOUT_PARAMETER);
+    agent.openAnalysisCache(ANALYSIS_CACHE_FILE);
+    agent.rootWorkers = ROOT_WORKERS;
 
     readInSaveFile(boards, distributions, size, filename);
 
@@ -18,6 +18,10 @@ class Wall(Structure):
 lib.calculateBestMove.argtypes = (Cell, Cell, POINTER(Wall), c_size_t, c_int, c_int, c_bool, c_int)
 lib.calculateBestMove.restype = c_uint8
 
+# uint8_t calculateBestMoveInTime(Cell whitePawn, Cell blackPawn, Wall* walls, size_t length, int whiteWalls, int blackWalls, bool player, int milliseconds)
+lib.calculateBestMoveInTime.argtypes = (Cell, Cell, POINTER(Wall), c_size_t, c_int, c_int, c_bool, c_int)
+lib.calculateBestMoveInTime.restype = c_uint8
+
 # uint8_t* getPossibleMoves(Cell whitePawn, Cell blackPawn, Wall* walls, size_t length, int whiteWalls, int blackWalls, bool player, size_t* outputLength)
 lib.getPossibleMoves.argtypes = (Cell, Cell, POINTER(Wall), c_size_t, c_int, c_int, c_bool, POINTER(c_size_t))
 lib.getPossibleMoves.restype = POINTER(c_uint8)
@@ -38,6 +42,17 @@ def calculateBestMove(board, player, rollouts = 10_000):
     return result
 
 
+def calculateBestMoveInTime(board, player, milliseconds = 1_000):
+    whitePawn = Cell(board.whitePawn[0], board.whitePawn[1])
+    blackPawn = Cell(board.blackPawn[0], board.blackPawn[1])
+    walls = (Wall * len(board.wallsOnBoard))(*board.wallsOnBoard)
+    length = len(walls)
+
+    result = lib.calculateBestMoveInTime(whitePawn, blackPawn, walls, length, board.whiteWalls, board.blackWalls, player, milliseconds)
+
+    return result
+
+
 def getPossibleMoves(board, player):
     whitePawn = Cell(board.whitePawn[0], board.whitePawn[1])
     blackPawn = Cell(board.blackPawn[0], board.blackPawn[1])